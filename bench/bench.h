@@ -0,0 +1,50 @@
+// bench.h - timing helpers for the benchmark drivers
+/*
+	Each driver in this directory is a standalone program including the fms headers from the
+	parent directory. Build with optimization and without _DEBUG, e.g.
+
+		cl /O2 /EHsc /I.. bench_pwflat_simd.cpp
+		g++ -std=c++14 -O2 -I.. bench_pwflat_simd.cpp -pthread
+*/
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+namespace bench {
+
+	// best of r runs of f() in milliseconds
+	template<class F>
+	inline double time_ms(F f, int r = 5)
+	{
+		typedef std::chrono::steady_clock clock;
+		double best = 0;
+
+		for (int i = 0; i < r; ++i) {
+			auto t0 = clock::now();
+			f();
+			double ms = std::chrono::duration<double, std::milli>(clock::now() - t0).count();
+			if (i == 0 || ms < best)
+				best = ms;
+		}
+
+		return best;
+	}
+
+	// address of the last result passed to use
+	inline const void* volatile& sink()
+	{
+		static const void* volatile p = nullptr;
+
+		return p;
+	}
+
+	// keep the optimizer from dropping results
+	template<class X>
+	inline void use(const X& x)
+	{
+		sink() = &x;
+	}
+
+} // bench
@@ -0,0 +1,85 @@
+// bench_heap.h - count heap blocks and bytes in use
+/*
+	Replaces the global operator new and delete. Include in one driver only.
+	Not thread safe: measure before starting any threads.
+*/
+#pragma once
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+namespace bench {
+
+	struct heap {
+		size_t blocks; // blocks in use
+		size_t bytes;  // bytes requested and in use
+		size_t news;   // calls to operator new
+	};
+
+	inline heap& heap_used()
+	{
+		static heap h = {0, 0, 0};
+
+		return h;
+	}
+
+	// size is stored in front of each block
+	static const size_t heap_header = 16;
+
+	inline void* heap_alloc(size_t n)
+	{
+		char* p = static_cast<char*>(malloc(n + heap_header));
+		if (!p)
+			throw std::bad_alloc();
+		*reinterpret_cast<size_t*>(p) = n;
+		++heap_used().blocks;
+		heap_used().bytes += n;
+		++heap_used().news;
+
+		return p + heap_header;
+	}
+#if defined(__GNUC__) && !defined(__clang__)
+	// free is the right call: the replacement operator new below allocates with malloc
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+	inline void heap_free(void* q)
+	{
+		if (!q)
+			return;
+
+		char* p = static_cast<char*>(q) - heap_header;
+		--heap_used().blocks;
+		heap_used().bytes -= *reinterpret_cast<size_t*>(p);
+		free(p);
+	}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+} // bench
+
+void* operator new(size_t n)
+{
+	return bench::heap_alloc(n);
+}
+void* operator new[](size_t n)
+{
+	return bench::heap_alloc(n);
+}
+void operator delete(void* p) noexcept
+{
+	bench::heap_free(p);
+}
+void operator delete[](void* p) noexcept
+{
+	bench::heap_free(p);
+}
+void operator delete(void* p, size_t) noexcept
+{
+	bench::heap_free(p);
+}
+void operator delete[](void* p, size_t) noexcept
+{
+	bench::heap_free(p);
+}
@@ -0,0 +1,55 @@
+// bench_portfolio.cpp - a book of bonds as vector_instruments and as a portfolio
+/*
+	bench_portfolio [bonds]
+
+	Semiannual bonds maturing every half year from 0.5y to 30y. Reports the time to build the
+	book, the heap blocks and bytes it uses, and the time to value every bond.
+*/
+#include <cstdlib>
+#include "bench.h"
+#include "bench_heap.h"
+#include "fms_forward.h"
+#include "fms_portfolio.h"
+
+using namespace fms;
+
+int main(int ac, char* av[])
+{
+	size_t n = ac > 1 ? atoi(av[1]) : 200000;
+
+	std::vector<double> mat(n), cpn(n);
+	for (size_t k = 0; k < n; ++k) {
+		mat[k] = 0.5*(1 + k % 60);
+		cpn[k] = 0.02 + 0.0001*(k % 97);
+	}
+	pwflat::vector_curve<> f(std::vector<double>{1, 2, 3, 5, 7, 10, 15, 20, 30}, std::vector<double>{.01, .015, .02, .025, .03, .035, .036, .037, .038}, .04);
+	std::vector<double> pv(n);
+
+	printf("%zu bonds\n", n);
+	printf("%-30s %10s %10s %10s %10s\n", "", "build ms", "blocks", "MB", "value ms");
+	{
+		bench::heap h0 = bench::heap_used();
+		std::vector<vector_instrument<>> v;
+		double ms = bench::time_ms([&]() {
+			std::vector<vector_instrument<>>().swap(v);
+			for (size_t k = 0; k < n; ++k)
+				v.push_back(instrument::bond<>(mat[k], instrument::SEMIANNUAL, cpn[k]));
+		}, 1);
+		bench::heap h = bench::heap_used();
+		double vs = bench::time_ms([&]() { for (size_t k = 0; k < n; ++k) pv[k] = pwflat::present_value(v[k], f); });
+		printf("%-30s %10.1f %10zu %10.1f %10.1f\n", "std::vector<vector_instrument>", ms, h.blocks - h0.blocks, (h.bytes - h0.bytes)/1e6, vs);
+	}
+	{
+		bench::heap h0 = bench::heap_used();
+		portfolio<> p;
+		double ms = bench::time_ms([&]() {
+			p.push_back(n, mat.data(), instrument::SEMIANNUAL, cpn.data());
+		}, 1);
+		bench::heap h = bench::heap_used();
+		double vs = bench::time_ms([&]() { for (size_t k = 0; k < n; ++k) pv[k] = pwflat::present_value(p[k], f); });
+		printf("%-30s %10.1f %10zu %10.1f %10.1f\n", "portfolio", ms, h.blocks - h0.blocks, (h.bytes - h0.bytes)/1e6, vs);
+	}
+	bench::use(pv);
+
+	return 0;
+}
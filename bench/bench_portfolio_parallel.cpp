@@ -0,0 +1,70 @@
+// bench_portfolio_parallel.cpp - parallel_pricer on 1, 2, 4, ... threads
+/*
+	bench_portfolio_parallel [instruments [threads]]
+
+	A book of deposits and semiannual bonds up to 30y valued serially and with parallel_pricer on pools
+	of increasing size up to threads, default std::thread::hardware_concurrency(). Reports the speedup
+	over one thread and the utilization of each worker and of the calling thread.
+*/
+#include <cstdlib>
+#include <thread>
+#include "bench.h"
+#include "fms_forward.h"
+#include "fms_portfolio_parallel.h"
+
+using namespace fms;
+
+int main(int ac, char* av[])
+{
+	size_t n = ac > 1 ? atoi(av[1]) : 100000;
+	size_t threads = ac > 2 ? atoi(av[2]) : std::thread::hardware_concurrency();
+	if (threads == 0)
+		threads = 1;
+
+	portfolio<> p;
+	for (size_t k = 0; k < n; ++k) {
+		if (k % 4 == 0) {
+			p.push_back(instrument::cd<>((1 + k % 12)/12., 0.02));
+		}
+		else {
+			double t = 0.5*(1 + k % 60), c = 0.02 + 0.0001*(k % 97);
+			p.push_back(1, &t, instrument::SEMIANNUAL, &c);
+		}
+	}
+	pwflat::vector_curve<> f(std::vector<double>{1, 2, 3, 5, 7, 10, 15, 20, 30}, std::vector<double>{.01, .015, .02, .025, .03, .035, .036, .037, .038}, .04);
+
+	pwflat::portfolio_total<> s{0, 0};
+	double ms1 = bench::time_ms([&]() {
+		s = pwflat::portfolio_total<>{0, 0};
+		for (size_t k = 0; k < p.size(); ++k) {
+			auto v = pwflat::evaluate(p[k], f);
+			s.pv += v.pv;
+			s.duration += v.duration;
+		}
+	});
+	printf("%zu instruments, %zu cash flows, %u hardware threads\n", p.size(), p.cash_flows(), std::thread::hardware_concurrency());
+	printf("serial      %8.2f ms  pv %.6f\n", ms1, s.pv);
+
+	pwflat::parallel_pricer<> q(p);
+	printf("%zu chunks\n", q.chunks());
+	double ms0 = 0;
+	pwflat::portfolio_total<> t0{0, 0};
+	for (size_t w = 1; w <= threads; w *= 2) {
+		thread_pool pool(w);
+		pwflat::portfolio_total<> t{0, 0};
+		double ms = bench::time_ms([&]() { t = q.value(f, pool); });
+		if (w == 1) {
+			ms0 = ms;
+			t0 = t;
+		}
+
+		auto u = q.stats();
+		printf("threads %3zu %8.2f ms  speedup %5.2f  stolen %zu  %s\n", w, ms, ms0/ms, u.stolen, t.pv == t0.pv && t.duration == t0.duration ? "" : "(total differs from 1 thread)");
+		printf("  utilization");
+		for (size_t i = 0; i < u.busy.size(); ++i)
+			printf(" %.2f", u[i]);
+		printf("\n");
+	}
+
+	return 0;
+}
@@ -0,0 +1,38 @@
+// bench_pwflat_search.cpp - lower_bound and eytzinger segment search at random times
+#include <random>
+#include "bench.h"
+#include "fms_pwflat.h"
+#include "fms_pwflat_search.h"
+
+using namespace fms::pwflat;
+
+int main()
+{
+	const size_t m = 2000000;
+	std::default_random_engine dre;
+
+	printf("%10s %12s %12s   ns per search\n", "n", "lower_bound", "eytzinger");
+	for (size_t n : {8, 64, 512, 11000, 1000000}) {
+		std::vector<double> t(n);
+		for (size_t i = 0; i < n; ++i)
+			t[i] = (i + 1.)/n;
+
+		std::uniform_real_distribution<> x(0, 1);
+		std::vector<double> u(m);
+		for (auto& uj : u)
+			uj = x(dre);
+
+		eytzinger<> e(n, t.data());
+		size_t s0 = 0, s1 = 0;
+		double ms0 = bench::time_ms([&]() { for (const auto& uj : u) s0 += segment(uj, n, t.data()); });
+		double ms1 = bench::time_ms([&]() { for (const auto& uj : u) s1 += e.segment(uj); });
+		if (s0 != s1)
+			printf("segments differ\n");
+		bench::use(s0);
+		bench::use(s1);
+
+		printf("%10zu %12.1f %12.1f\n", n, 1e6*ms0/m, 1e6*ms1/m);
+	}
+
+	return 0;
+}
@@ -0,0 +1,61 @@
+// bench_pwflat_simd.cpp - scalar, AVX2, and AVX-512 exp and discount
+#include <cmath>
+#include <random>
+#include "bench.h"
+#include "fms_pwflat_simd.h"
+
+using namespace fms::pwflat;
+
+inline const char* name(simd::isa i)
+{
+	return i == simd::AVX512 ? "AVX512" : i == simd::AVX2 ? "AVX2" : "SCALAR";
+}
+
+int main()
+{
+	const size_t m = 1000000;
+	std::default_random_engine dre;
+	std::uniform_real_distribution<> x(-5, 0), v(0, 30);
+
+	std::vector<double> e(m), y(m), z(m);
+	for (auto& ej : e)
+		ej = x(dre);
+
+	// 30y quarterly curve and sorted times
+	std::vector<double> t(120), f(120), u(m), D(m);
+	for (size_t i = 0; i < t.size(); ++i) {
+		t[i] = 0.25*(i + 1);
+		f[i] = 0.01 + 1e-4*i;
+	}
+	for (auto& uj : u)
+		uj = v(dre);
+	std::sort(u.begin(), u.end());
+	simd::evaluator ev(t.size(), t.data(), f.data(), 0.03);
+
+	double ms = bench::time_ms([&]() { for (size_t j = 0; j < m; ++j) z[j] = ::exp(e[j]); });
+	printf("exp, std::exp     %6.2f ns\n", 1e6*ms/m);
+	ms = bench::time_ms([&]() { for (size_t j = 0; j < m; ++j) D[j] = discount(u[j], t.size(), t.data(), f.data(), 0.03); });
+	printf("discount, scalar  %6.2f ns\n", 1e6*ms/m);
+
+	for (auto i : {simd::SCALAR, simd::AVX2, simd::AVX512}) {
+		if (i > simd::best())
+			continue;
+
+		ms = bench::time_ms([&]() { simd::exp(m, e.data(), y.data(), i); });
+		double err = 0;
+		for (size_t j = 0; j < m; ++j)
+			err = std::max(err, simd::ulp(y[j], z[j]));
+		printf("exp, %-7s       %6.2f ns, max %g ulp\n", name(i), 1e6*ms/m, err);
+
+		ms = bench::time_ms([&]() { ev.discount(m, u.data(), y.data(), i); });
+		err = 0;
+		for (size_t j = 0; j < m; ++j)
+			err = std::max(err, simd::ulp(y[j], D[j]));
+		printf("discount, %-7s  %6.2f ns, max %g ulp\n", name(i), 1e6*ms/m, err);
+	}
+	bench::use(y);
+	bench::use(z);
+	bench::use(D);
+
+	return 0;
+}
@@ -0,0 +1,63 @@
+// bench_shared_instrument.cpp - a book of bonds with and without shared cash flow times
+/*
+	bench_shared_instrument [bonds]
+
+	Bonds maturing in 1 to 30 years paying quarterly or semiannually, so there are 60 distinct
+	time grids. Reports the heap used by the book as vector_instruments and as shared_instruments,
+	and the time to compute present value and duration of every bond one at a time and with
+	pwflat::present_values.
+*/
+#include <cstdlib>
+#include "bench.h"
+#include "bench_heap.h"
+#include "fms_forward.h"
+#include "fms_shared_instrument.h"
+
+using namespace fms;
+
+int main(int ac, char* av[])
+{
+	size_t n = ac > 1 ? atoi(av[1]) : 100000;
+
+	pwflat::vector_curve<> f(std::vector<double>{1, 2, 3, 5, 7, 10, 15, 20, 30}, std::vector<double>{.01, .015, .02, .025, .03, .035, .036, .037, .038}, .04);
+
+	bench::heap h0 = bench::heap_used();
+	std::vector<vector_instrument<>> v;
+	v.reserve(n);
+	for (size_t k = 0; k < n; ++k) {
+		auto freq = (k/30) % 2 ? instrument::QUARTERLY : instrument::SEMIANNUAL;
+		v.push_back(instrument::bond<>(1. + k % 30, freq, 0.01 + 0.0001*(k % 97)));
+	}
+	bench::heap h1 = bench::heap_used();
+
+	grid_pool<> pool;
+	std::vector<shared_instrument<>> s;
+	s.reserve(n);
+	for (size_t k = 0; k < n; ++k)
+		s.push_back(shared_instrument<>(pool, v[k]));
+	bench::heap h2 = bench::heap_used();
+
+	size_t flows = 0;
+	for (const auto& i : v)
+		flows += i.m;
+	printf("%zu bonds, %zu cash flows, %zu grids\n", n, flows, pool.size());
+	printf("vector_instrument book %8.1f MB %8zu blocks\n", (h1.bytes - h0.bytes)/1e6, h1.blocks - h0.blocks);
+	printf("shared_instrument book %8.1f MB %8zu blocks\n", (h2.bytes - h1.bytes)/1e6, h2.blocks - h1.blocks);
+
+	std::vector<const instrument_base<>*> is;
+	for (const auto& i : s)
+		is.push_back(&i);
+	std::vector<double> pv(n), dur(n), pv2(n), dur2(n);
+
+	double ms0 = bench::time_ms([&]() {
+		for (size_t k = 0; k < n; ++k) {
+			pv[k] = pwflat::present_value(v[k], f);
+			dur[k] = pwflat::duration(v[k], f);
+		}
+	});
+	double ms1 = bench::time_ms([&]() { pwflat::present_values(n, is.data(), f, pv2.data(), dur2.data()); });
+	printf("present_value and duration of each  %8.1f ms\n", ms0);
+	printf("present_values on shared grids      %8.1f ms  %s\n", ms1, pv == pv2 && dur == dur2 ? "identical" : "values differ");
+
+	return 0;
+}
@@ -0,0 +1,53 @@
+// bench_thread_pool.cpp - curve builds on 1, 2, 4, ... threads
+/*
+	bench_thread_pool [curves [threads]]
+
+	Bootstraps curves of 40 semiannual bonds with pwflat::build on pools of increasing size up
+	to threads, default std::thread::hardware_concurrency(), and reports the speedup over one thread.
+*/
+#include <cstdlib>
+#include <thread>
+#include "bench.h"
+#include "fms_forward_build.h"
+
+using namespace fms;
+
+int main(int ac, char* av[])
+{
+	size_t curves = ac > 1 ? atoi(av[1]) : 400;
+	size_t threads = ac > 2 ? atoi(av[2]) : std::thread::hardware_concurrency();
+	if (threads == 0)
+		threads = 1;
+
+	std::vector<instrument::bond<>> b;
+	for (int k = 1; k <= 40; ++k)
+		b.push_back(instrument::bond<>(0.5*k, instrument::SEMIANNUAL, 0.03));
+	std::vector<pwflat::curve_job<>> jobs(curves);
+	for (size_t j = 0; j < curves; ++j) {
+		for (const auto& bk : b)
+			jobs[j].i.push_back(&bk);
+		jobs[j].p.assign(b.size(), 1 + 0.0001*(j % 50));
+	}
+
+	double ms1 = bench::time_ms([&]() {
+		for (const auto& job : jobs) {
+			pwflat::forward<> f;
+			f.next(job.i.size(), job.i.data(), job.p.data());
+			bench::use(f);
+		}
+	});
+	printf("%zu curves of %zu bonds, %u hardware threads\n", curves, b.size(), std::thread::hardware_concurrency());
+	printf("sequential %8.2f ms\n", ms1);
+
+	double ms0 = 0;
+	for (size_t n = 1; n <= threads; n *= 2) {
+		thread_pool pool(n);
+		size_t s = pool.stolen();
+		double ms = bench::time_ms([&]() { bench::use(pwflat::build(jobs, pool)); });
+		if (n == 1)
+			ms0 = ms;
+		printf("threads %3zu %8.2f ms  speedup %5.2f  stolen %zu\n", n, ms, ms0/ms, pool.stolen() - s);
+	}
+
+	return 0;
+}
@@ -1,6 +1,11 @@
 // fms_bootstrap.h - bootstrap a curve
 #pragma once
+#include <string>
+#include <utility>
+#include <vector>
 #include "newton.h"
+#include "fms_error.h"
+#include "fms_expected.h"
 //#include "fms_curve.h"
 //#include "fms_instrument.h"
 #include "fms_pwflat.h"
@@ -8,9 +13,72 @@
 namespace fms {
 namespace bootstrap {
 
+	// number of pillars solved by each method on this thread
+	struct path_count {
+		size_t closed_form;
+		size_t newton;
+		size_t iterations; // newton iterations
+	};
+	inline path_count& paths()
+	{
+		static thread_local path_count count{0, 0, 0};
+
+		return count;
+	}
+
+	// forward past t0 making the present value of c[i] at u[i] > t0 equal to p - p0 using initial guess _f
+	// only the new segment is evaluated: D(u) = exp(-(I0 + _f (u - t0))) where I0 = int_0^t0 f(t) dt
+	// u and c are pointers or random access iterators
+	template<class T, class F, class U, class C>
+	inline expected<F> try_extend(size_t m, U u, C c, const T& t0, const F& I0, F p, F p0, F _f) noexcept
+	{
+		// one cash flow: c[0] exp(-(I0 + _f (u[0] - t0))) = p - p0, e.g. a cd
+		if (m == 1 && (p - p0)/c[0] > 0) {
+			++paths().closed_form;
+
+			return (log(c[0]/(p - p0)) - I0)/(u[0] - t0);
+		}
+		// two cash flows with nothing to reprice: c[0] exp(-_f u[0]) = -c[1] exp(-_f u[1]), e.g. a fra past the curve end
+		if (m == 2 && p == p0 && -c[1]/c[0] > 0 && u[0] < u[1]) {
+			++paths().closed_form;
+
+			return log(-c[1]/c[0])/(u[1] - u[0]);
+		}
+
+		++paths().newton;
+
+		// present value and its derivative share the discounts
+		auto pv = [m,u,c,t0,I0,p,p0](F _f) {
+			F pv_{0}, dur_{0};
+			for (size_t j = 0; j < m; ++j) {
+				F D = exp(-(I0 + _f*(u[j] - t0)));
+				pv_ += c[j]*D;
+				dur_ -= (u[j] - t0)*c[j]*D;
+			}
+
+			return std::make_pair(-p + p0 + pv_, dur_);
+		};
+
+		auto r = newton::solve(_f, pv);
+		paths().iterations += r.iterations;
+		if (r.status != newton::CONVERGED)
+			return errc::not_converged;
+
+		return r.x;
+	}
+	template<class T, class F, class U, class C>
+	inline F extend(size_t m, U u, C c, const T& t0, const F& I0, F p, F p0, F _f)
+	{
+		auto r = try_extend<T,F>(m, u, c, t0, I0, p, p0, _f);
+		if (!r)
+			throw std::runtime_error(FMS_WHERE + message(r.error()));
+
+		return *r;
+	}
+
 	// extend f(t) to make present value of c[i] at u[i] equal to p using initial guess _f
-	template<class T, class F>
-	inline F next(size_t m, const T* u, const F* c, size_t n, const T* t, const F* f, F p = 0, F _f = 0)
+	template<class T, class F, class U, class C>
+	inline expected<F> try_next(size_t m, U u, C c, size_t n, const T* t, const F* f, F p = 0, F _f = 0) noexcept
 	{
 		// end of current curve
 		T t0 = n > 0 ? t[n - 1] : 0;
@@ -18,29 +86,162 @@ namespace bootstrap {
 		// index to cash flows before end of curve
 		auto ui = std::upper_bound(u, u + m, t0);
 		if (ui == u + m)
-			throw std::runtime_error(__FILE__ ": " __FUNCTION__ ": no cash flows past end of curve");
+			return errc::no_cash_flows;
 
-		// present values of cash flows to end of curve
-		auto m0 = ui - u;
-		F p0 = pwflat::present_value(m0, u, c, n, t, f);
+		// present values of cash flows to end of curve, same values as pwflat::present_value
+		size_t m0 = ui - u;
+		F p0{0};
+		if (std::is_sorted(u, ui)) {
+			pwflat::sweep<T,F> s(n, t, f);
+			for (size_t i = 0; i < m0; ++i)
+				p0 += c[i]*s.discount(u[i]);
+		}
+		else {
+			for (size_t i = 0; i < m0; ++i)
+				p0 += c[i]*pwflat::discount(u[i], n, t, f);
+		}
 
-		// incrment to cash flows past curve end
-		m -= m0;
-		u += m0;
-		c += m0;
-
-		auto pv = [p,p0,m,u,c,n,t,f](F _f) {
-			return -p + p0 + pwflat::present_value(m, u, c, n, t, f, _f);
-		};
-		auto dur = [m,u,c,n,t,f](F _f) {
-			return pwflat::duration_extrapolated(m, u, c, n, t, f, _f);
-		};
+		// integral to end of curve
+		F I0{0};
+		T t_{0};
+		for (size_t i = 0; i < n; ++i) {
+			I0 += f[i]*(t[i] - t_);
+			t_ = t[i];
+		}
 
 		// initial bootstrap guess
 		if (_f == 0)
 			_f = n > 0 ? f[n - 1] : F(.01);
 
-		return newton::root<F,F>(_f, pv, dur);
+		return try_extend<T,F>(m - m0, u + m0, c + m0, t0, I0, p, p0, _f);
+	}
+	template<class T, class F, class U, class C>
+	inline F next(size_t m, U u, C c, size_t n, const T* t, const F* f, F p = 0, F _f = 0)
+	{
+		auto r = try_next<T,F>(m, u, c, n, t, f, p, _f);
+		if (!r)
+			throw std::runtime_error(FMS_WHERE + message(r.error()));
+
+		return *r;
+	}
+
+	// extend a curve of n points by k instruments of increasing maturity
+	// instrument j has m[j] cash flows c[j] at sorted times u[j] and price p[j]
+	// t and f must have room for n + k points and t[n + j] is set to the maturity of instrument j
+	// the integral at the curve end is carried forward and cash flows before the end are discounted
+	// using cumulative integrals at each curve time, so each Newton iteration only costs
+	// the cash flows past the curve end
+	// the result is identical to calling next for each instrument on the curve built so far
+	// if J is not null it is set to the k x k row major lower triangular jacobian J[j*k + l] = df[n + j]/dp[l]
+	// returns the number of instruments bootstrapped and the error that stopped it, if any
+	template<class T, class F>
+	inline std::pair<size_t, errc> try_build(size_t k, const size_t* m, const T* const* u, const F* const* c, const F* p,
+		size_t n, T* t, F* f, F _f = 0, F* J = nullptr) noexcept
+	{
+		size_t n0 = n;
+		std::vector<F> I, df;
+		try {
+			I.resize(n + k);
+			df.resize(J ? n + k : 0);
+		}
+		catch (const std::bad_alloc&) {
+			return std::make_pair(size_t(0), errc::out_of_memory);
+		}
+
+
+		// I[i] = int_0^t[i] f(t) dt accumulated as in pwflat::sweep
+		F I0{0};
+		T t_{0};
+		for (size_t i = 0; i < n; ++i) {
+			I0 += f[i]*(t[i] - t_);
+			t_ = t[i];
+			I[i] = I0;
+		}
+
+		for (size_t j = 0; j < k; ++j, ++n) {
+			T t0 = n > 0 ? t[n - 1] : 0;
+			const T* uj = u[j];
+			const F* cj = c[j];
+
+			auto ui = std::upper_bound(uj, uj + m[j], t0);
+			if (ui == uj + m[j])
+				return std::make_pair(j, errc::no_cash_flows);
+			size_t m0 = ui - uj;
+
+			// same operations as pwflat::present_value
+			F p0{0};
+			size_t i = 0;
+			for (size_t l = 0; l < m0; ++l) {
+				if (uj[l] < 0) {
+					p0 = std::numeric_limits<F>::quiet_NaN();
+
+					break;
+				}
+				while (i < n && t[i] < uj[l])
+					++i;
+				F fi = i == n ? std::numeric_limits<F>::quiet_NaN() : f[i];
+				F Il = (i == 0 ? F(0) : I[i - 1]) + fi*(uj[l] - (i == 0 ? T(0) : t[i - 1]));
+				p0 += cj[l]*exp(-Il);
+			}
+
+			F g = _f;
+			if (g == 0)
+				g = n > 0 ? f[n - 1] : F(.01);
+
+			auto fn = try_extend<T,F>(m[j] - m0, uj + m0, cj + m0, t0, I0, p[j], p0, g);
+			if (!fn)
+				return std::make_pair(j, fn.error());
+			f[n] = *fn;
+			t[n] = uj[m[j] - 1];
+
+			I0 += f[n]*(t[n] - t_);
+			t_ = t[n];
+			I[n] = I0;
+
+			// differentiate pv_j(f[0], ..., f[n]) = p[j] wrt p[l] with forwards before n0 held fixed
+			// J[j][l] = (delta_jl - sum_{l <= i < j} dpv_j/df[n0 + i] J[i][l])/(dpv_j/df[n])
+			if (J) {
+				// only allocates for unsorted cash flows
+				try {
+					pwflat::sensitivity(m[j], uj, cj, n + 1, t, f, std::numeric_limits<F>::quiet_NaN(), df.data());
+				}
+				catch (const std::bad_alloc&) {
+					return std::make_pair(j, errc::out_of_memory);
+				}
+				const F* dpv = df.data() + n0;
+				F* Jj = J + j*k;
+
+				for (size_t l = 0; l <= j; ++l) {
+					F s = l == j ? F(1) : F(0);
+					for (size_t i = l; i < j; ++i)
+						s -= dpv[i]*J[i*k + l];
+					Jj[l] = s/dpv[j];
+				}
+				std::fill(Jj + j + 1, Jj + k, F(0));
+			}
+		}
+
+		return std::make_pair(k, errc::ok);
+	}
+	template<class T, class F>
+	inline void build(size_t k, const size_t* m, const T* const* u, const F* const* c, const F* p,
+		size_t n, T* t, F* f, F _f = 0, F* J = nullptr)
+	{
+		auto r = try_build<T,F>(k, m, u, c, p, n, t, f, _f, J);
+		if (r.second != errc::ok)
+			throw std::runtime_error(FMS_WHERE + message(r.second));
+	}
+
+	// sensitivity to par quotes from sensitivities df[i] to forwards on k bootstrapped pillars
+	// dp[l] = sum_{i >= l} df[i] J[i*k + l] where J is the jacobian from build
+	template<class F>
+	inline void par_sensitivity(size_t k, const F* J, const F* df, F* dp)
+	{
+		for (size_t l = 0; l < k; ++l) {
+			dp[l] = 0;
+			for (size_t i = l; i < k; ++i)
+				dp[l] += df[i]*J[i*k + l];
+		}
 	}
 
 } // bootstrap
@@ -82,7 +283,7 @@ inline void test_fms_bootstrap()
 	{ // bootstrap
 		double eps = std::numeric_limits<double>::epsilon();
 		double f0 = 0.04; // D(t) = exp(-t*f0)
-		double f[3];
+		double f[3] = {0};
 		double t[] = {1,2,3};
 		double c0[1], c1[2], c2[3];
 
@@ -104,6 +305,42 @@ inline void test_fms_bootstrap()
 		c2[2] = (1 - c2[0]*exp(-t[0]*f0)-c2[1]*exp(-t[1]*f0))/exp(-t[2]*f0); //!!! replace with appropriate value
 		f[2] = bootstrap::next<double,double>(3,t,c2, 2,t,f, 1);
 		assert (fabs(f[2] - f0) < eps);
+
+		// all at once
+		size_t m[] = {1, 2, 3};
+		const double* u[] = {t, t, t};
+		const double* c[] = {c0, c1, c2};
+		double p[] = {1, 1, 1};
+		double t_[3], f_[3];
+		bootstrap::build<double,double>(3, m, u, c, p, 0, t_, f_);
+		assert (std::equal(t, t + 3, t_));
+		assert (std::equal(f, f + 3, f_));
+	}
+	{ // closed form for one cash flow and for two cash flows past the curve end
+		auto count = bootstrap::paths();
+
+		double t[] = {1};
+		double f[] = {.03};
+		double u[] = {2};
+		double c[] = {1.1};
+		double f1 = bootstrap::next(1,u,c, 1,t,f, 1.);
+		assert (bootstrap::paths().closed_form == count.closed_form + 1);
+		assert (fabs(present_value(1,u,c, 1,t,f, f1) - 1) < 2*std::numeric_limits<double>::epsilon());
+
+		// fra from 1.5 to 2.5
+		double v[] = {1.5, 2.5};
+		double d[] = {-1, 1.05};
+		double f2 = bootstrap::next(2,v,d, 1,t,f, 0.);
+		assert (bootstrap::paths().closed_form == count.closed_form + 2);
+		assert (fabs(present_value(2,v,d, 1,t,f, f2)) < 2*std::numeric_limits<double>::epsilon());
+		assert (fabs(f2 - log(1.05)) < 2*std::numeric_limits<double>::epsilon());
+
+		// no closed form
+		double w[] = {1.5, 2.5};
+		double e[] = {.05, 1.05};
+		bootstrap::next(2,w,e, 1,t,f, 1.);
+		assert (bootstrap::paths().closed_form == count.closed_form + 2);
+		assert (bootstrap::paths().newton == count.newton + 1);
 	}
 }
 
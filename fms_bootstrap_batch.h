@@ -0,0 +1,321 @@
+// fms_bootstrap_batch.h - bootstrap many price scenarios for one set of instruments
+/*
+	Every scenario has the same curve times, the maturities of the instruments, so the segment
+	of each cash flow is found once and the forwards and integrals of all scenarios are stored
+	in lanes: F[j*S + s] is forward j in scenario s. Discounts for all lanes are computed
+	with the vector exp from fms_pwflat_simd.h and Newton steps are taken for all lanes at once.
+
+	A lane is masked off when its step is within tolerance. Lanes that have not converged after
+	max_iter steps, or whose derivative is not usable, are solved with bootstrap::try_extend.
+	Forwards agree with forward::next to within the accuracy of the vector exp.
+
+	try_batch reports an errc for each scenario and a scenario that cannot be solved does not
+	stop the others. batch throws if any scenario fails.
+*/
+#pragma once
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "fms_bootstrap.h"
+#include "fms_error.h"
+#include "fms_pwflat_simd.h"
+
+namespace fms {
+namespace bootstrap {
+
+	// bootstrap S scenarios of k instruments of increasing maturity
+	// instrument j has m[j] cash flows c[j] at sorted times u[j] and price p[s*k + j] in scenario s
+	// sets t[j] to the maturity of instrument j and f[s*k + j] to forward j in scenario s
+	// sets e[s] to the error that stopped scenario s, if any, and its forwards from there on to NaN
+	// a failing scenario does not affect the others
+	// returns the number of pillars over all scenarios that needed the scalar solver
+	inline size_t try_batch(size_t k, const size_t* m, const double* const* u, const double* const* c,
+		size_t S, const double* p, double* t, double* f, errc* e,
+		size_t max_iter = 20, pwflat::simd::isa isa = pwflat::simd::best()) noexcept
+	{
+		static const double tol = 2*std::numeric_limits<double>::epsilon();
+		static const double nan = std::numeric_limits<double>::quiet_NaN();
+		std::fill(e, e + S, errc::ok);
+
+		std::vector<double> F, I;  // forwards and integrals to each time in lanes
+		std::vector<double> I0, p0, x, x_, pv, dur, a, D;
+		std::vector<unsigned char> active;
+		try {
+			F.resize(k*S);
+			I.resize(k*S);
+			for (auto v : {&I0, &p0, &x, &x_, &pv, &dur, &a, &D})
+				v->resize(S);
+			active.resize(S);
+		}
+		catch (const std::bad_alloc&) {
+			std::fill(e, e + S, errc::out_of_memory);
+			std::fill(t, t + k, nan);
+			std::fill(f, f + S*k, nan);
+
+			return 0;
+		}
+		size_t scalar = 0;
+
+		for (size_t j = 0; j < k; ++j) {
+			double t0 = j > 0 ? t[j - 1] : 0;
+			const double* uj = u[j];
+			const double* cj = c[j];
+
+			size_t m0 = std::upper_bound(uj, uj + m[j], t0) - uj;
+			if (m0 == m[j]) {
+				// every scenario stops here
+				for (size_t s = 0; s < S; ++s)
+					if (e[s] == errc::ok)
+						e[s] = errc::no_cash_flows;
+				std::fill(t + j, t + k, nan);
+				std::fill(F.begin() + j*S, F.end(), nan);
+
+				break;
+			}
+			t[j] = uj[m[j] - 1];
+
+			if (j > 0)
+				std::copy(I.begin() + (j - 1)*S, I.begin() + j*S, I0.begin());
+			else
+				std::fill(I0.begin(), I0.end(), 0.);
+
+			// present value of cash flows to the end of the curve
+			std::fill(p0.begin(), p0.end(), 0.);
+			for (size_t l = 0, i = 0; l < m0; ++l) {
+				if (uj[l] < 0) {
+					std::fill(p0.begin(), p0.end(), std::numeric_limits<double>::quiet_NaN());
+
+					break;
+				}
+				while (i < j && t[i] < uj[l])
+					++i;
+				const double* Fi = F.data() + i*S;
+				double du = uj[l] - (i > 0 ? t[i - 1] : 0);
+				if (i > 0) {
+					const double* Ii = I.data() + (i - 1)*S;
+					for (size_t s = 0; s < S; ++s)
+						a[s] = -(Ii[s] + Fi[s]*du);
+				}
+				else {
+					for (size_t s = 0; s < S; ++s)
+						a[s] = -(Fi[s]*du);
+				}
+				pwflat::simd::exp(S, a.data(), D.data(), isa);
+				for (size_t s = 0; s < S; ++s)
+					p0[s] += cj[l]*D[s];
+			}
+
+			// initial guess as in next
+			if (j > 0)
+				std::copy(F.begin() + (j - 1)*S, F.begin() + j*S, x.begin());
+			else
+				std::fill(x.begin(), x.end(), .01);
+
+			size_t m1 = m[j] - m0;
+			const double* u1 = uj + m0;
+			const double* c1 = cj + m0;
+			// failed scenarios stay NaN
+			for (size_t s = 0; s < S; ++s) {
+				active[s] = e[s] == errc::ok;
+				if (!active[s])
+					x[s] = nan;
+			}
+
+			if (m1 == 1) {
+				// closed form as in extend
+				for (size_t s = 0; s < S; ++s) {
+					double q = p[s*k + j] - p0[s];
+					if (active[s] && q/c1[0] > 0) {
+						x[s] = (log(c1[0]/q) - I0[s])/(u1[0] - t0);
+						active[s] = 0;
+					}
+				}
+			}
+			else {
+				size_t n_active = std::count(active.begin(), active.end(), 1);
+				for (size_t iter = 0; n_active > 0 && iter < max_iter; ++iter) {
+					std::fill(pv.begin(), pv.end(), 0.);
+					std::fill(dur.begin(), dur.end(), 0.);
+					for (size_t l = 0; l < m1; ++l) {
+						double du = u1[l] - t0;
+						for (size_t s = 0; s < S; ++s)
+							a[s] = -(I0[s] + x[s]*du);
+						pwflat::simd::exp(S, a.data(), D.data(), isa);
+						for (size_t s = 0; s < S; ++s) {
+							pv[s] += c1[l]*D[s];
+							dur[s] -= du*c1[l]*D[s];
+						}
+					}
+
+					// newton step on active lanes
+					for (size_t s = 0; s < S; ++s) {
+						double y = -p[s*k + j] + p0[s] + pv[s];
+						x_[s] = x[s] - y/dur[s];
+					}
+					n_active = 0;
+					for (size_t s = 0; s < S; ++s) {
+						if (!active[s])
+							continue;
+						if (!std::isfinite(x_[s])) {
+							// stop this lane, the scalar solver below restarts it from the previous pillar's forward
+							active[s] = 2;
+							continue;
+						}
+						double dx = x_[s] - x[s];
+						x[s] = x_[s];
+						if (fabs(dx) <= tol*std::max(fabs(x[s]), 1.))
+							active[s] = 0;
+						else
+							++n_active;
+					}
+				}
+			}
+
+			// finish lanes the vector loop could not, starting again from the previous forward
+			for (size_t s = 0; s < S; ++s) {
+				if (active[s]) {
+					double g = j > 0 ? F[(j - 1)*S + s] : .01;
+					auto r = try_extend<double,double>(m1, u1, c1, t0, I0[s], p[s*k + j], p0[s], g);
+					if (r) {
+						x[s] = *r;
+					}
+					else {
+						e[s] = r.error();
+						x[s] = nan;
+					}
+					++scalar;
+				}
+			}
+
+			double* Fj = F.data() + j*S;
+			double* Ij = I.data() + j*S;
+			for (size_t s = 0; s < S; ++s) {
+				Fj[s] = x[s];
+				Ij[s] = I0[s] + x[s]*(t[j] - t0);
+			}
+		}
+
+		// scenarios are rows of the result
+		for (size_t s = 0; s < S; ++s)
+			for (size_t j = 0; j < k; ++j)
+				f[s*k + j] = F[j*S + s];
+
+		return scalar;
+	}
+	// throws if any scenario fails
+	inline size_t batch(size_t k, const size_t* m, const double* const* u, const double* const* c,
+		size_t S, const double* p, double* t, double* f,
+		size_t max_iter = 20, pwflat::simd::isa isa = pwflat::simd::best())
+	{
+		std::vector<errc> e(S);
+		size_t n = try_batch(k, m, u, c, S, p, t, f, e.data(), max_iter, isa);
+		for (size_t s = 0; s < S; ++s)
+			if (e[s] != errc::ok)
+				throw std::runtime_error(FMS_WHERE + "scenario " + std::to_string(s) + ": " + message(e[s]));
+
+		return n;
+	}
+
+} // bootstrap
+} // fms
+
+#ifdef _DEBUG
+#include <cassert>
+#include <random>
+#include "fms_forward.h"
+
+inline void test_fms_bootstrap_batch()
+{
+	using namespace fms;
+
+	std::default_random_engine dre;
+	std::uniform_real_distribution<> u(-0.01, 0.01);
+
+	// deposits then bonds
+	std::vector<vector_instrument<>> i;
+	i.push_back(instrument::cd<>(0.25, 0.02));
+	i.push_back(instrument::cd<>(0.5, 0.021));
+	for (int y = 1; y <= 10; ++y)
+		i.push_back(instrument::bond<>(y, instrument::SEMIANNUAL, 0.03 + 0.002*y));
+	size_t k = i.size();
+
+	std::vector<size_t> m(k);
+	std::vector<const double*> t(k), c(k);
+	for (size_t j = 0; j < k; ++j) {
+		m[j] = i[j].m;
+		t[j] = i[j].u;
+		c[j] = i[j].c;
+	}
+
+	size_t S = 37; // not a multiple of the vector width
+	std::vector<double> p(S*k);
+	for (auto& pj : p)
+		pj = 1 + u(dre);
+	p[5*k + 7] = 1.3; // needs more iterations
+
+	for (auto isa : {pwflat::simd::SCALAR, pwflat::simd::best()}) {
+		std::vector<double> tb(k), fb(S*k);
+		size_t n = bootstrap::batch(k, m.data(), t.data(), c.data(), S, p.data(), tb.data(), fb.data(), 20, isa);
+		assert (n == 0);
+
+		for (size_t s = 0; s < S; ++s) {
+			pwflat::forward<> f;
+			for (size_t j = 0; j < k; ++j)
+				f.next(i[j], p[s*k + j]);
+			for (size_t j = 0; j < k; ++j) {
+				assert (tb[j] == f.t[j]);
+				assert (fabs(fb[s*k + j] - f.f[j]) < 1e-13);
+			}
+		}
+
+		// too few iterations falls back to the scalar solver
+		n = bootstrap::batch(k, m.data(), t.data(), c.data(), S, p.data(), tb.data(), fb.data(), 1, isa);
+		assert (n > 0);
+		for (size_t s = 0; s < S; ++s) {
+			pwflat::forward<> f;
+			for (size_t j = 0; j < k; ++j)
+				f.next(i[j], p[s*k + j]);
+			for (size_t j = 0; j < k; ++j)
+				assert (fabs(fb[s*k + j] - f.f[j]) < 1e-13);
+		}
+
+		// a price no forward can match stops only its scenario
+		std::vector<double> q(p);
+		q[3*k + 4] = -1;
+		std::vector<errc> e(S);
+		bootstrap::try_batch(k, m.data(), t.data(), c.data(), S, q.data(), tb.data(), fb.data(), e.data(), 20, isa);
+		for (size_t s = 0; s < S; ++s) {
+			assert (e[s] == (s == 3 ? errc::not_converged : errc::ok));
+			pwflat::forward<> f;
+			for (size_t j = 0; j < k && !(s == 3 && j == 4); ++j)
+				f.next(i[j], q[s*k + j]);
+			for (size_t j = 0; j < k; ++j) {
+				if (j < f.n)
+					assert (fabs(fb[s*k + j] - f.f[j]) < 1e-13);
+				else
+					assert (std::isnan(fb[s*k + j]));
+			}
+		}
+		try {
+			bootstrap::batch(k, m.data(), t.data(), c.data(), S, q.data(), tb.data(), fb.data(), 20, isa);
+			assert (false);
+		}
+		catch (const std::runtime_error&) { }
+
+		// an instrument maturing before the last pillar stops every scenario
+		std::swap(t[1], t[2]);
+		std::swap(c[1], c[2]);
+		std::swap(m[1], m[2]);
+		bootstrap::try_batch(k, m.data(), t.data(), c.data(), S, p.data(), tb.data(), fb.data(), e.data(), 20, isa);
+		for (size_t s = 0; s < S; ++s) {
+			assert (e[s] == errc::no_cash_flows);
+			assert (!std::isnan(fb[s*k + 1]) && std::isnan(fb[s*k + 2]));
+		}
+		assert (tb[1] == 1 && std::isnan(tb[2]));
+		std::swap(t[1], t[2]);
+		std::swap(c[1], c[2]);
+		std::swap(m[1], m[2]);
+	}
+}
+
+#endif // _DEBUG
@@ -1,8 +1,14 @@
 // fms_curve.h - set of points for a curve
 // IDEA: template<class T, class F> class curve { T t; F f; iterator_traits<F>::value_type _f; ... }
 #pragma once
+#include <array>
+#include <string>
 #include <vector>
+#include "fms_error.h"
+#include "fms_expected.h"
 #include "fms_pwflat.h"
+#include "fms_pwflat_search.h"
+#include "fms_small_vector.h"
 
 namespace fms {
 namespace pwflat {
@@ -38,15 +44,15 @@ namespace pwflat {
 		}
 		F integral(const T& u) const
 		{
-			return pwflat::integral(u, n,t,f);
+			return pwflat::integral(u, n,t,f,_f);
 		}
 		F spot(const T& u) const
 		{
-			return pwflat::spot(u, n,t,f);
+			return pwflat::spot(u, n,t,f,_f);
 		}
 		F discount(const T& u) const
 		{
-			return pwflat::discount(u, n,t,f);
+			return pwflat::discount(u, n,t,f,_f);
 		}
 
 		// last maturity in curve
@@ -57,46 +63,70 @@ namespace pwflat {
 	};
 
 	// a regular value type
+	// up to 8 points are stored in the object
 	template<class T = double, class F = double>
 	class vector_curve : public curve<T,F> {
 	protected:
-		std::vector<T> t_;
-		std::vector<F> f_;
+		small_vector<T> t_;
+		small_vector<F> f_;
+
+		// point base members at storage
+		void reset()
+		{
+			curve<T,F>::n = t_.size();
+			curve<T,F>::t = t_.data();
+			curve<T,F>::f = f_.data();
+		}
 	public:
 		vector_curve(size_t n = 0)
 			: curve<T,F>(n)
 		{
-			t = t_.data();
-			f = f_.data();
+			this->t = t_.data();
+			this->f = f_.data();
 		}
 		vector_curve(size_t n, const T* t, const F* f, double _f = std::numeric_limits<F>::quiet_NaN())
 			: curve<T,F>(n, 0, 0, _f), t_(t, t + n), f_(f, f + n)
 		{
-			curve<T,F>::t = t_.data();
-			curve<T,F>::f = f_.data();
+			reset();
 		}
 		vector_curve(const std::vector<T>& t, const std::vector<F>& f, double _f = std::numeric_limits<F>::quiet_NaN())
-			: curve<T,F>(t.size(), 0, 0, _f), t_(t), f_(f)
+			: curve<T,F>(t.size(), 0, 0, _f), t_(t.begin(), t.end()), f_(f.begin(), f.end())
 		{
 			if (t.size() != f.size())
-				throw std::runtime_error(__FILE__ ": " __FUNCTION__ "time and forward vector must be the same size");
+				throw std::runtime_error(FMS_WHERE + "time and forward vector must be the same size");
 
-			curve<T,F>::t = t_.data();
-			curve<T,F>::f = f_.data();
+			reset();
 		}
 		vector_curve(const vector_curve& c)
-			: vector_curve<T,F>(c.t_, c.f_, c._f)
-		{ }
+			: curve<T,F>(c.n, 0, 0, c._f), t_(c.t_), f_(c.f_)
+		{
+			reset();
+		}
+		vector_curve(vector_curve&& c) noexcept
+			: curve<T,F>(c.n, 0, 0, c._f), t_(std::move(c.t_)), f_(std::move(c.f_))
+		{
+			reset();
+			c.reset();
+		}
 		vector_curve& operator=(const vector_curve& c)
 		{
 			if (this != &c) {
 				t_ = c.t_;
 				f_ = c.f_;
+				curve<T,F>::_f = c._f;
+				reset();
+			}
 
-				n = c.n;
-				t = t_.data();
-				f = f_.data();
-				_f = c._f;
+			return *this;
+		}
+		vector_curve& operator=(vector_curve&& c) noexcept
+		{
+			if (this != &c) {
+				t_ = std::move(c.t_);
+				f_ = std::move(c.f_);
+				curve<T,F>::_f = c._f;
+				reset();
+				c.reset();
 			}
 
 			return *this;
@@ -107,20 +137,301 @@ namespace pwflat {
 		// extend using a time and forward value
 		vector_curve& push_back(const T& u, const F& g)
 		{
-			if (u <= last())
-				throw std::runtime_error(__FILE__ ": " __FUNCTION__ ": curve times must be increasing");
+			auto e = try_push_back(u, g);
+			if (e != errc::ok)
+				throw std::runtime_error(FMS_WHERE + message(e));
 
-			t_.push_back(u);
-			f_.push_back(g);
+			return *this;
+		}
+		// leaves the curve unchanged on error
+		errc try_push_back(const T& u, const F& g) noexcept
+		{
+			curve<T,F>& c = *this;
+
+			if (u <= c.last())
+				return errc::not_increasing;
+
+			try {
+				t_.push_back(u);
+				try {
+					f_.push_back(g);
+				}
+				catch (const std::bad_alloc&) {
+					t_.pop_back();
+					throw;
+				}
+			}
+			catch (const std::bad_alloc&) {
+				return errc::out_of_memory;
+			}
 
 			// update base members
-			++n;
-			t = t_.data();
-			f = f_.data();
+			reset();
+
+			return errc::ok;
+		}
+
+	};
+
+	// vector_curve with cumulative integrals and discounts at each time
+	// point queries are a segment search, one multiply-add, and one exp
+	// curves with at least search_threshold points search an eytzinger index
+	template<class T = double, class F = double>
+	class prefix_curve : public vector_curve<T,F> {
+	protected:
+		std::vector<F> I_; // I_[i] = int_0^t[i] f(s) ds
+		std::vector<F> D_; // D_[i] = exp(-I_[i])
+		search_index<T> s_;
+
+		void update()
+		{
+			const curve<T,F>& c = *this;
+
+			I_.resize(c.n);
+			D_.resize(c.n);
+			pwflat::integrals(c.n, c.t, c.f, I_.data());
+			std::transform(I_.begin(), I_.end(), D_.begin(), [](const F& I) { return exp(-I); });
+			s_ = search_index<T>(c.n, c.t);
+		}
+	public:
+		prefix_curve()
+			: vector_curve<T,F>()
+		{ }
+		prefix_curve(size_t n, const T* t, const F* f, double _f = std::numeric_limits<F>::quiet_NaN())
+			: vector_curve<T,F>(n, t, f, _f)
+		{
+			update();
+		}
+		prefix_curve(const std::vector<T>& t, const std::vector<F>& f, double _f = std::numeric_limits<F>::quiet_NaN())
+			: vector_curve<T,F>(t, f, _f)
+		{
+			update();
+		}
+		explicit prefix_curve(const curve<T,F>& c)
+			: prefix_curve(c.n, c.t, c.f, c._f)
+		{ }
+		prefix_curve(const prefix_curve& c)
+			: vector_curve<T,F>(c), I_(c.I_), D_(c.D_), s_(c.s_)
+		{
+			s_.reset(curve<T,F>::n, curve<T,F>::t);
+		}
+		prefix_curve& operator=(const prefix_curve& c)
+		{
+			if (this != &c) {
+				vector_curve<T,F>::operator=(c);
+				I_ = c.I_;
+				D_ = c.D_;
+				s_ = c.s_;
+				s_.reset(curve<T,F>::n, curve<T,F>::t);
+			}
 
 			return *this;
 		}
+		~prefix_curve()
+		{ }
+
+		// cumulative integral and discount at curve times
+		const F* integrals() const
+		{
+			return I_.data();
+		}
+		const F* discounts() const
+		{
+			return D_.data();
+		}
+
+		// smallest i with u <= t[i], or n
+		size_t segment(const T& u) const
+		{
+			return s_.segment(u);
+		}
+
+		// same values as pwflat::value
+		F operator()(const T& u) const
+		{
+			const curve<T,F>& c = *this;
+
+			if (u < 0)
+				return std::numeric_limits<F>::quiet_NaN();
+
+			auto i = segment(u);
+
+			return i == c.n ? c._f : c.f[i];
+		}
+		// same values as pwflat::integral
+		F integral(const T& u) const
+		{
+			const curve<T,F>& c = *this;
+
+			if (u < 0)
+				return std::numeric_limits<F>::quiet_NaN();
+
+			auto i = segment(u);
+			F I_0 = i == 0 ? F(0) : I_[i - 1];
+			T t_0 = i == 0 ? T(0) : c.t[i - 1];
+
+			return I_0 + (i == c.n ? c._f : c.f[i])*(u - t_0);
+		}
+		// D(u) = D(t[i-1]) exp(-f[i](u - t[i-1]))
+		F discount(const T& u) const
+		{
+			const curve<T,F>& c = *this;
+
+			if (u < 0)
+				return std::numeric_limits<F>::quiet_NaN();
+
+			auto i = segment(u);
+			F D_0 = i == 0 ? F(1) : D_[i - 1];
+			T t_0 = i == 0 ? T(0) : c.t[i - 1];
+
+			return D_0*exp(-(i == c.n ? c._f : c.f[i])*(u - t_0));
+		}
+		F spot(const T& u) const
+		{
+			const curve<T,F>& c = *this;
+
+			return c.n > 0 && u <= c.t[0] ? c.f[0] : integral(u)/u;
+		}
 
+		// extend and update cumulative values
+		prefix_curve& push_back(const T& u, const F& g)
+		{
+			auto e = try_push_back(u, g);
+			if (e != errc::ok)
+				throw std::runtime_error(FMS_WHERE + message(e));
+
+			return *this;
+		}
+		errc try_push_back(const T& u, const F& g) noexcept
+		{
+			const curve<T,F>& c = *this;
+
+			try {
+				I_.reserve(c.n + 1);
+				D_.reserve(c.n + 1);
+			}
+			catch (const std::bad_alloc&) {
+				return errc::out_of_memory;
+			}
+
+			auto e = vector_curve<T,F>::try_push_back(u, g);
+			if (e != errc::ok)
+				return e;
+
+			F I = (c.n > 1 ? I_[c.n - 2] : F(0)) + g*(u - (c.n > 1 ? c.t[c.n - 2] : T(0)));
+			I_.push_back(I);
+			D_.push_back(exp(-I));
+			try {
+				s_.reset(c.n, c.t);
+			}
+			catch (const std::bad_alloc&) {
+				// the index covers fewer points and searches the rest
+			}
+
+			return errc::ok;
+		}
+	};
+
+	// segment I of a curve with N points unrolled at compile time
+	template<size_t I, size_t N>
+	struct unroll {
+		// f[i] if t[i-1] < u <= t[i] for i >= I
+		template<class T, class F>
+		static constexpr F value(const T& u, const std::array<T,N>& t, const std::array<F,N>& f, const F& _f)
+		{
+			return u <= t[I] ? f[I] : unroll<I + 1, N>::value(u, t, f, _f);
+		}
+		// add int_t_^u f(t) dt to I_ where t_ = t[I-1], same operations as pwflat::integral
+		template<class T, class F>
+		static constexpr F integral(const T& u, const std::array<T,N>& t, const std::array<F,N>& f, const F& _f, const F& I_, const T& t_)
+		{
+			return t[I] <= u
+				? unroll<I + 1, N>::integral(u, t, f, _f, I_ + f[I]*(t[I] - t_), t[I])
+				: I_ + f[I]*(u - t_);
+		}
+	};
+	template<size_t N>
+	struct unroll<N,N> {
+		template<class T, class F>
+		static constexpr F value(const T&, const std::array<T,N>&, const std::array<F,N>&, const F& _f)
+		{
+			return _f;
+		}
+		template<class T, class F>
+		static constexpr F integral(const T& u, const std::array<T,N>&, const std::array<F,N>&, const F& _f, const F& I_, const T& t_)
+		{
+			return u > t_ ? I_ + _f*(u - t_) : I_;
+		}
+	};
+
+	// curve with N points stored inline
+	// value and integral are constexpr and unrolled
+	template<size_t N, class T = double, class F = double>
+	struct fixed_curve {
+		std::array<T,N> t;
+		std::array<F,N> f;
+		F _f;
+
+		constexpr fixed_curve(const std::array<T,N>& t, const std::array<F,N>& f, const F& _f = std::numeric_limits<F>::quiet_NaN())
+			: t(t), f(f), _f(_f)
+		{ }
+
+		constexpr size_t size() const
+		{
+			return N;
+		}
+
+		// view of the points as a curve, no copy is made
+		curve<T,F> view() const
+		{
+			return curve<T,F>(N, t.data(), f.data(), _f);
+		}
+		operator curve<T,F>() const
+		{
+			return view();
+		}
+
+		constexpr F operator()(const T& u) const
+		{
+			return u < 0 ? std::numeric_limits<F>::quiet_NaN() : unroll<0,N>::value(u, t, f, _f);
+		}
+		constexpr F integral(const T& u) const
+		{
+			return u < 0 ? std::numeric_limits<F>::quiet_NaN() : unroll<0,N>::integral(u, t, f, _f, F(0), T(0));
+		}
+		F discount(const T& u) const
+		{
+			return exp(-integral(u));
+		}
+		F spot(const T& u) const
+		{
+			return N > 0 && u <= t[0] ? f[0] : integral(u)/u;
+		}
+
+		// value of cash flows c[i] at times u[i]
+		F present_value(size_t m, const T* u, const F* c) const
+		{
+			F p{0};
+
+			for (size_t i = 0; i < m; ++i)
+				p += c[i]*discount(u[i]);
+
+			return p;
+		}
+		F duration(size_t m, const T* u, const F* c) const
+		{
+			F d{0};
+
+			for (size_t i = 0; i < m; ++i)
+				d -= u[i]*c[i]*discount(u[i]);
+
+			return d;
+		}
+
+		constexpr T last() const
+		{
+			return N > 0 ? t[N - 1] : 0;
+		}
 	};
 
 } // pwflat
@@ -141,6 +452,23 @@ inline void test_fms_curve()
 		c = c2;
 		assert (!(c != c2));
 	}
+	{ // moves point at the moved storage
+		size_t a = small_vector_allocations();
+		pwflat::vector_curve<> c(std::vector<double>{1, 2, 3}, std::vector<double>{.01, .02, .03}, .04);
+		pwflat::vector_curve<> d(std::move(c));
+		assert (d.n == 3 && d.t[2] == 3 && d.f[2] == .03 && d._f == .04);
+		assert (c.n == 0);
+		c = std::move(d);
+		assert (c.n == 3 && c(2.5) == .03);
+		c.push_back(4, .035);
+		assert (c.n == 4 && c.t[3] == 4);
+		assert (small_vector_allocations() == a);
+		for (int i = 5; i < 20; ++i)
+			c.push_back(i, .04);
+		assert (small_vector_allocations() > a);
+		d = c;
+		assert (d == c && d.t != c.t);
+	}
 	{
 		double t[] = {1,2,3};
 		double f[] = {.1,.2,.3};
@@ -194,6 +522,94 @@ inline void test_fms_curve()
 
 		assert(c3 == c);
 	}
+	{ // prefix_curve agrees with pwflat functions
+		std::vector<double> t{.5, 1, 2, 3, 5}, f{.01, .02, .015, .03, .025};
+		pwflat::vector_curve<> c(t, f, .02);
+		pwflat::prefix_curve<> p(t, f, .02);
+		assert (p == c);
+
+		for (double u : {-1., 0., .25, .5, .75, 1., 1.5, 2., 3., 4., 5., 7.}) {
+			double I = pwflat::integral(u, c.n, c.t, c.f, c._f);
+			double D = pwflat::discount(u, c.n, c.t, c.f, c._f);
+			double r = pwflat::spot(u, c.n, c.t, c.f, c._f);
+			if (u < 0) {
+				assert (std::isnan(p.integral(u)));
+				assert (std::isnan(p.discount(u)));
+			}
+			else {
+				assert (I == p.integral(u));
+				assert (fabs(D - p.discount(u)) <= 4*std::numeric_limits<double>::epsilon());
+				assert (fabs(r - p.spot(u)) <= 4*std::numeric_limits<double>::epsilon());
+			}
+		}
+
+		// no extrapolation past last time
+		pwflat::prefix_curve<> p_(t, f);
+		assert (std::isnan(p_.integral(6)));
+		assert (std::isnan(p_.discount(6)));
+		assert (p_.integral(5) == p.integral(5));
+
+		// push_back keeps cumulative values current
+		pwflat::prefix_curve<> q;
+		assert (std::isnan(q.discount(1)));
+		for (size_t i = 0; i < t.size(); ++i)
+			q.push_back(t[i], f[i]);
+		assert (q == p);
+		for (size_t i = 0; i < t.size(); ++i) {
+			assert (q.integrals()[i] == p.integrals()[i]);
+			assert (q.discounts()[i] == p.discounts()[i]);
+		}
+	}
+	{ // large prefix_curve uses a search index
+		pwflat::prefix_curve<> p;
+		std::vector<double> u;
+		for (int i = 1; i <= 1000; ++i) {
+			p.push_back(i/365., 0.01 + i*1e-5);
+			u.push_back((i - 0.5)/365.);
+			u.push_back(i/365.);
+		}
+		auto q = p; // copy points the index at its own times
+		p = pwflat::prefix_curve<>();
+		for (double ui : u) {
+			assert (q(ui) == pwflat::value(ui, q.n, q.t, q.f));
+			assert (q.integral(ui) == pwflat::integral(ui, q.n, q.t, q.f));
+		}
+		assert (std::isnan(q(-1)));
+		assert (std::isnan(q.integral(3)));
+	}
+	{ // fixed_curve
+		constexpr pwflat::fixed_curve<3> c({{1, 2, 3}}, {{.1, .2, .3}}, .4);
+		static_assert(c(0.5) == .1, "fixed_curve value");
+		static_assert(c(2) == .2, "fixed_curve value");
+		static_assert(c(4) == .4, "fixed_curve value");
+		static_assert(c.integral(0) == 0, "fixed_curve integral");
+		static_assert(c.integral(1.5) == .1 + .2*.5, "fixed_curve integral");
+		static_assert(c.last() == 3, "fixed_curve last");
+
+		pwflat::curve<> v = c.view();
+		assert (v.t == c.t.data());
+		for (double u : {-1., 0., .5, 1., 1.5, 2., 2.5, 3., 3.5, 10.}) {
+			if (u < 0) {
+				assert (std::isnan(c(u)));
+				assert (std::isnan(c.integral(u)));
+			}
+			else {
+				assert (c(u) == v(u));
+				assert (c.integral(u) == v.integral(u));
+				assert (c.discount(u) == v.discount(u));
+			}
+			assert (c.spot(u) == v.spot(u));
+		}
+
+		constexpr pwflat::fixed_curve<2> c_({{1, 2}}, {{.1, .2}});
+		assert (c_.integral(2) == .1 + .2); // no extrapolation needed at the last time
+		assert (std::isnan(c_.integral(2.5)));
+
+		double u[] = {.5, 1, 2.5, 3.5};
+		double cf[] = {1, 2, 3, 4};
+		assert (c.present_value(4, u, cf) == pwflat::present_value(4, u, cf, 3, v.t, v.f, v._f));
+		assert (c.duration(4, u, cf) == pwflat::duration(4, u, cf, 3, v.t, v.f, v._f));
+	}
 }
 
 #endif // _DEBUG
\ No newline at end of file
@@ -0,0 +1,246 @@
+// fms_curve_expr.h - sums of curves without temporaries
+/*
+	auto e = expr(ois) + expr(basis) + 0.0001;
+
+	The forward of a sum is the sum of the forwards and the integral is the sum of the integrals,
+	so value, integral, and discount are evaluated lazily from the components. Each node also
+	reports next(u), the smallest curve time after u, so the merged time grid can be walked
+	on the fly. Use materialize() when repeated evaluation makes a flat copy cheaper.
+
+	Leaves hold a copy of the curve header, not the data. The curves must outlive the expression.
+*/
+#pragma once
+#include <limits>
+#include <vector>
+#include "fms_curve.h"
+
+namespace fms {
+namespace pwflat {
+
+	// E must provide value(u), integral(u), next(u), and extrapolate()
+	template<class E, class T = double, class F = double>
+	struct curve_expr {
+		const E& expr() const
+		{
+			return static_cast<const E&>(*this);
+		}
+
+		F operator()(const T& u) const
+		{
+			return expr().value(u);
+		}
+		F discount(const T& u) const
+		{
+			return exp(-expr().integral(u));
+		}
+		F spot(const T& u) const
+		{
+			T t0 = expr().next(0);
+
+			return u <= t0 && t0 < std::numeric_limits<T>::infinity() ? expr().value(t0) : expr().integral(u)/u;
+		}
+
+		// value of cash flows c[i] at sorted times u[i] walking the merged time grid
+		// returns NaN for the whole sum if any u[i] < 0
+		F present_value(size_t m, const T* u, const F* c) const
+		{
+			F p{0};
+			F I{0};
+			T t_{0};
+
+			for (size_t i = 0; i < m; ++i) {
+				if (u[i] < 0)
+					return std::numeric_limits<F>::quiet_NaN();
+
+				T t1;
+				while ((t1 = expr().next(t_)) < u[i]) {
+					I += expr().value(t1)*(t1 - t_);
+					t_ = t1;
+				}
+				p += c[i]*exp(-(I + expr().value(u[i])*(u[i] - t_)));
+			}
+
+			return p;
+		}
+
+		// copy the merged curve
+		vector_curve<T,F> materialize() const
+		{
+			std::vector<T> t;
+			std::vector<F> f;
+
+			for (T u = expr().next(0); u < std::numeric_limits<T>::infinity(); u = expr().next(u)) {
+				t.push_back(u);
+				f.push_back(expr().value(u));
+			}
+
+			return vector_curve<T,F>(t, f, expr().extrapolate());
+		}
+	};
+
+	// curve leaf
+	template<class T = double, class F = double>
+	class curve_ref : public curve_expr<curve_ref<T,F>,T,F> {
+		curve<T,F> c;
+	public:
+		curve_ref(const curve<T,F>& c)
+			: c(c.n, c.t, c.f, c._f)
+		{ }
+
+		F value(const T& u) const
+		{
+			return pwflat::value(u, c.n, c.t, c.f, c._f);
+		}
+		F integral(const T& u) const
+		{
+			return pwflat::integral(u, c.n, c.t, c.f, c._f);
+		}
+		T next(const T& u) const
+		{
+			auto i = std::upper_bound(c.t, c.t + c.n, u);
+
+			return i == c.t + c.n ? std::numeric_limits<T>::infinity() : *i;
+		}
+		F extrapolate() const
+		{
+			return c._f;
+		}
+	};
+
+	// constant forward, e.g. a scenario shift
+	template<class T = double, class F = double>
+	class constant_curve : public curve_expr<constant_curve<T,F>,T,F> {
+		F s;
+	public:
+		constant_curve(const F& s)
+			: s(s)
+		{ }
+
+		F value(const T& u) const
+		{
+			return u < 0 ? std::numeric_limits<F>::quiet_NaN() : s;
+		}
+		F integral(const T& u) const
+		{
+			return u < 0 ? std::numeric_limits<F>::quiet_NaN() : s*u;
+		}
+		T next(const T&) const
+		{
+			return std::numeric_limits<T>::infinity();
+		}
+		F extrapolate() const
+		{
+			return s;
+		}
+	};
+
+	template<class L, class R, class T = double, class F = double>
+	class curve_sum : public curve_expr<curve_sum<L,R,T,F>,T,F> {
+		L l;
+		R r;
+	public:
+		curve_sum(const L& l, const R& r)
+			: l(l), r(r)
+		{ }
+
+		F value(const T& u) const
+		{
+			return l.value(u) + r.value(u);
+		}
+		F integral(const T& u) const
+		{
+			return l.integral(u) + r.integral(u);
+		}
+		// merge the time grids
+		T next(const T& u) const
+		{
+			T lu = l.next(u), ru = r.next(u);
+
+			return lu < ru ? lu : ru;
+		}
+		F extrapolate() const
+		{
+			return l.extrapolate() + r.extrapolate();
+		}
+	};
+
+	template<class T, class F>
+	inline curve_ref<T,F> expr(const curve<T,F>& c)
+	{
+		return curve_ref<T,F>(c);
+	}
+
+	template<class L, class R, class T, class F>
+	inline curve_sum<L,R,T,F> operator+(const curve_expr<L,T,F>& l, const curve_expr<R,T,F>& r)
+	{
+		return curve_sum<L,R,T,F>(l.expr(), r.expr());
+	}
+	template<class L, class T, class F>
+	inline curve_sum<L,constant_curve<T,F>,T,F> operator+(const curve_expr<L,T,F>& l, const F& s)
+	{
+		return curve_sum<L,constant_curve<T,F>,T,F>(l.expr(), constant_curve<T,F>(s));
+	}
+	template<class R, class T, class F>
+	inline curve_sum<constant_curve<T,F>,R,T,F> operator+(const F& s, const curve_expr<R,T,F>& r)
+	{
+		return curve_sum<constant_curve<T,F>,R,T,F>(constant_curve<T,F>(s), r.expr());
+	}
+	template<class T, class F>
+	inline curve_sum<curve_ref<T,F>,curve_ref<T,F>,T,F> operator+(const curve<T,F>& l, const curve<T,F>& r)
+	{
+		return expr(l) + expr(r);
+	}
+
+} // pwflat
+} // fms
+
+#ifdef _DEBUG
+#include <cassert>
+
+inline void test_fms_curve_expr()
+{
+	using namespace fms::pwflat;
+
+	vector_curve<> ois(std::vector<double>{1, 2, 3}, std::vector<double>{.01, .02, .03}, .035);
+	vector_curve<> basis(std::vector<double>{.5, 2, 4}, std::vector<double>{.001, .002, .003}, .004);
+
+	auto e = ois + basis + .0001;
+	auto c = e.materialize();
+	double t[] = {.5, 1, 2, 3, 4}, f[] = {.0111, .0121, .0221, .0331, .0381};
+	assert (c.n == 5);
+	for (size_t i = 0; i < c.n; ++i) {
+		assert (c.t[i] == t[i]);
+		assert (fabs(c.f[i] - f[i]) < 1e-15);
+	}
+	assert (fabs(c._f - .0391) < 1e-15);
+
+	double u[] = {0, .25, .5, 1, 1.5, 2, 2.5, 3, 3.5, 4, 5, 10};
+	double cf[] = {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 101};
+	for (double ui : u) {
+		assert (fabs(e(ui) - c(ui)) < 1e-15);
+		assert (fabs(e.integral(ui) - c.integral(ui)) < 1e-15);
+		assert (fabs(e.discount(ui) - c.discount(ui)) < 1e-15);
+		assert (fabs(e.spot(ui) - c.spot(ui)) < 1e-15);
+	}
+	assert (std::isnan(e(-1)));
+	assert (fabs(e.present_value(12, u, cf) - present_value(12, u, cf, c.n, c.t, c.f, c._f)) < 1e-13);
+	double v[] = {1, -1};
+	assert (std::isnan(e.present_value(2, v, cf)));
+
+	// shift on either side
+	auto e1 = .0001 + (ois + basis);
+	for (double ui : u) {
+		assert (e1(ui) == e(ui));
+		assert (e1.integral(ui) == e.integral(ui));
+	}
+	assert (e1.present_value(12, u, cf) == e.present_value(12, u, cf));
+
+	// no extrapolation
+	vector_curve<> ois_(std::vector<double>{1, 2, 3}, std::vector<double>{.01, .02, .03});
+	auto e_ = expr(ois_) + expr(basis);
+	assert (std::isnan(e_(3.5)));
+	assert (!std::isnan(e_(3)));
+	assert (std::isnan(e_.materialize()._f));
+}
+
+#endif // _DEBUG
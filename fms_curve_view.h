@@ -0,0 +1,218 @@
+// fms_curve_view.h - bumped and shifted views of a curve
+/*
+	A view refers to the times and forwards of an existing curve and changes them
+	without copying. The integral of the underlying curve is adjusted analytically:
+
+	parallel shift s:         int_0^u f(t) + s dt = I(u) + s u
+	bump f[k] by h:           I(u) + h (min(u, t[k]) - t[k-1])^+
+	extrapolate with g:       the underlying curve with _f = g
+
+	Views hold a copy of the curve header, not the data, so they are cheap to create
+	in scenario loops. The underlying curve must outlive the view.
+*/
+#pragma once
+#include <algorithm>
+#include "fms_curve.h"
+
+namespace fms {
+namespace pwflat {
+
+	// V must provide value(u, f(u)) and integral(u, I(u)) adjusting the underlying curve
+	template<class V, class T = double, class F = double>
+	class curve_view {
+	protected:
+		curve<T,F> c; // underlying curve header
+	public:
+		curve_view(const curve<T,F>& c)
+			: c(c.n, c.t, c.f, c._f)
+		{ }
+
+		const curve<T,F>& base() const
+		{
+			return c;
+		}
+		const V& view() const
+		{
+			return static_cast<const V&>(*this);
+		}
+
+		F operator()(const T& u) const
+		{
+			return view().value(u, pwflat::value(u, c.n, c.t, c.f, c._f));
+		}
+		F integral(const T& u) const
+		{
+			return view().integral(u, pwflat::integral(u, c.n, c.t, c.f, c._f));
+		}
+		F discount(const T& u) const
+		{
+			return exp(-integral(u));
+		}
+		F spot(const T& u) const
+		{
+			return c.n > 0 && u <= c.t[0] ? operator()(c.t[0]) : integral(u)/u;
+		}
+		T last() const
+		{
+			return c.last();
+		}
+
+		// value of cash flows c[i] at times u[i] in O(m + n) for sorted times, O(m log n) otherwise
+		F present_value(size_t m, const T* u, const F* c_) const
+		{
+			F p{0};
+
+			if (std::is_sorted(u, u + m)) {
+				sweep<T,F> s(c.n, c.t, c.f, c._f);
+				for (size_t i = 0; i < m; ++i)
+					p += c_[i]*exp(-view().integral(u[i], s.integral(u[i])));
+			}
+			else {
+				for (size_t i = 0; i < m; ++i)
+					p += c_[i]*discount(u[i]);
+			}
+
+			return p;
+		}
+		F duration(size_t m, const T* u, const F* c_) const
+		{
+			F d{0};
+
+			if (std::is_sorted(u, u + m)) {
+				sweep<T,F> s(c.n, c.t, c.f, c._f);
+				for (size_t i = 0; i < m; ++i)
+					d -= u[i]*c_[i]*exp(-view().integral(u[i], s.integral(u[i])));
+			}
+			else {
+				for (size_t i = 0; i < m; ++i)
+					d -= u[i]*c_[i]*discount(u[i]);
+			}
+
+			return d;
+		}
+	};
+
+	// forward curve plus a parallel shift
+	template<class T = double, class F = double>
+	class shifted_curve : public curve_view<shifted_curve<T,F>,T,F> {
+		F s;
+	public:
+		shifted_curve(const curve<T,F>& c, const F& s)
+			: curve_view<shifted_curve<T,F>,T,F>(c), s(s)
+		{ }
+
+		F value(const T&, const F& f) const
+		{
+			return f + s;
+		}
+		F integral(const T& u, const F& I) const
+		{
+			return I + s*u;
+		}
+		using curve_view<shifted_curve<T,F>,T,F>::integral;
+	};
+
+	// forward curve with f[k] bumped by h, k = n bumps the extrapolation
+	template<class T = double, class F = double>
+	class bumped_curve : public curve_view<bumped_curve<T,F>,T,F> {
+		size_t k;
+		F h;
+		T t0, t1; // bumped segment (t0, t1]
+	public:
+		bumped_curve(const curve<T,F>& c, size_t k, const F& h)
+			: curve_view<bumped_curve<T,F>,T,F>(c), k(k), h(h),
+			  t0(k == 0 ? T(0) : c.t[k - 1]), t1(k == c.n ? std::numeric_limits<T>::infinity() : c.t[k])
+		{ }
+
+		F value(const T& u, const F& f) const
+		{
+			return (k == 0 ? u <= t1 : t0 < u && u <= t1) ? f + h : f;
+		}
+		F integral(const T& u, const F& I) const
+		{
+			return u > t0 ? I + h*((u < t1 ? u : t1) - t0) : I;
+		}
+		using curve_view<bumped_curve<T,F>,T,F>::integral;
+	};
+
+	// forward curve with a different extrapolation value
+	template<class T = double, class F = double>
+	class extrapolated_curve : public curve_view<extrapolated_curve<T,F>,T,F> {
+	public:
+		extrapolated_curve(const curve<T,F>& c, const F& _f)
+			: curve_view<extrapolated_curve<T,F>,T,F>(c)
+		{
+			curve_view<extrapolated_curve<T,F>,T,F>::c._f = _f;
+		}
+
+		F value(const T&, const F& f) const
+		{
+			return f;
+		}
+		F integral(const T&, const F& I) const
+		{
+			return I;
+		}
+		using curve_view<extrapolated_curve<T,F>,T,F>::integral;
+	};
+
+} // pwflat
+} // fms
+
+#ifdef _DEBUG
+#include <cassert>
+
+inline void test_fms_curve_view()
+{
+	using namespace fms::pwflat;
+
+	std::vector<double> t{1, 2, 3}, f{.01, .02, .03};
+	vector_curve<> c(t, f, .04);
+	double u[] = {0, .5, 1, 1.5, 2, 2.5, 3, 3.5, 5};
+	double cf[] = {1, 2, 3, 4, 5, 6, 7, 8, 9};
+
+	auto check = [&u,&cf](const auto& v, const curve<>& w) {
+		for (double ui : u) {
+			assert (fabs(v(ui) - w(ui)) < 1e-15);
+			assert (fabs(v.integral(ui) - w.integral(ui)) < 1e-15);
+			assert (fabs(v.discount(ui) - w.discount(ui)) < 1e-15);
+			assert (fabs(v.spot(ui) - w.spot(ui)) < 1e-15);
+		}
+		assert (fabs(v.present_value(9, u, cf) - present_value(9, u, cf, w.n, w.t, w.f, w._f)) < 1e-13);
+		assert (fabs(v.duration(9, u, cf) - duration(9, u, cf, w.n, w.t, w.f, w._f)) < 1e-13);
+
+		// unsorted times
+		double ur[] = {10, 7, 4, 3.5, 2, 1.5, 1, 0.5, 0.25};
+		assert (fabs(v.present_value(9, ur, cf) - present_value(9, ur, cf, w.n, w.t, w.f, w._f)) < 1e-13);
+		assert (fabs(v.duration(9, ur, cf) - duration(9, ur, cf, w.n, w.t, w.f, w._f)) < 1e-13);
+	};
+
+	{ // parallel shift
+		shifted_curve<> v(c, .001);
+		vector_curve<> w(t, std::vector<double>{.011, .021, .031}, .041);
+		check(v, w);
+		assert (std::isnan(v(-1)));
+	}
+	{ // bump each segment
+		for (size_t k = 0; k <= t.size(); ++k) {
+			bumped_curve<> v(c, k, .001);
+			std::vector<double> g(f);
+			if (k < t.size())
+				g[k] += .001;
+			vector_curve<> w(t, g, k < t.size() ? .04 : .041);
+			check(v, w);
+		}
+	}
+	{ // extrapolation
+		extrapolated_curve<> v(c, .05);
+		vector_curve<> w(t, f, .05);
+		check(v, w);
+
+		vector_curve<> c_(t, f);
+		extrapolated_curve<> v_(c_, .05);
+		check(v_, w);
+		assert (std::isnan(c_.integral(4)));
+	}
+}
+
+#endif // _DEBUG
@@ -0,0 +1,11 @@
+// fms_error.h - where an exception was thrown
+/*
+	__FUNCTION__ is a string literal on MSVC but a variable on gcc and clang, so it cannot be
+	pasted to other literals. FMS_WHERE is "file: function: " as a std::string on all of them.
+
+		throw std::runtime_error(FMS_WHERE + "message");
+*/
+#pragma once
+#include <string>
+
+#define FMS_WHERE (std::string(__FILE__ ": ") + __FUNCTION__ + ": ")
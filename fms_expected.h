@@ -0,0 +1,103 @@
+// fms_expected.h - error codes for the non-throwing api
+/*
+	Functions named try_xxx are noexcept and report failure with an errc, or an expected<X>
+	holding either a value or an errc. The functions without the prefix call them and throw
+	std::runtime_error with the same message.
+*/
+#pragma once
+#include <stdexcept>
+
+namespace fms {
+
+	enum class errc {
+		ok = 0,
+		no_cash_flows,  // no cash flows past end of curve
+		not_converged,  // forward did not converge
+		not_increasing, // times must be increasing
+		size_mismatch,  // arrays must be the same size
+		out_of_memory,
+	};
+
+	inline const char* message(errc e)
+	{
+		switch (e) {
+		case errc::ok:
+			return "ok";
+		case errc::no_cash_flows:
+			return "no cash flows past end of curve";
+		case errc::not_converged:
+			return "forward did not converge";
+		case errc::not_increasing:
+			return "curve times must be increasing";
+		case errc::size_mismatch:
+			return "sizes must be equal";
+		case errc::out_of_memory:
+			return "out of memory";
+		}
+
+		return "unknown error";
+	}
+
+	// value or the reason it could not be computed
+	template<class X>
+	class expected {
+		X x;
+		errc e;
+	public:
+		expected(const X& x)
+			: x(x), e(errc::ok)
+		{ }
+		expected(errc e)
+			: x(), e(e)
+		{ }
+
+		explicit operator bool() const
+		{
+			return e == errc::ok;
+		}
+		errc error() const
+		{
+			return e;
+		}
+		// undefined if there is an error
+		const X& operator*() const
+		{
+			return x;
+		}
+		const X& value() const
+		{
+			if (e != errc::ok)
+				throw std::runtime_error(message(e));
+
+			return x;
+		}
+	};
+
+} // fms
+
+#ifdef _DEBUG
+#include <cassert>
+#include <cstring>
+
+inline void test_fms_expected()
+{
+	using fms::errc;
+
+	fms::expected<double> x(1.5);
+	assert (x);
+	assert (x.error() == errc::ok);
+	assert (*x == 1.5 && x.value() == 1.5);
+
+	fms::expected<double> y(errc::no_cash_flows);
+	assert (!y);
+	assert (y.error() == errc::no_cash_flows);
+	try {
+		y.value();
+		assert (false);
+	}
+	catch (const std::runtime_error& ex) {
+		assert (0 == strcmp(ex.what(), fms::message(errc::no_cash_flows)));
+	}
+}
+
+#endif // _DEBUG
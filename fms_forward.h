@@ -1,8 +1,12 @@
 // fms_forward.h - forward curve
 #pragma once
+#include <algorithm>
+#include <numeric>
 #include <vector>
 #include "fms_bootstrap.h"
 #include "fms_curve.h"
+#include "fms_curve_view.h"
+#include "fms_error.h"
 #include "fms_instrument.h"
 
 namespace fms {
@@ -27,6 +31,62 @@ namespace pwflat {
 		return duration(i.m,i.u,i.c, c.n,c.t,c.f,c._f);
 	}
 
+	// d(pv)/df[i] for each curve forward followed by d(pv)/d_f
+	template<class T, class F>
+	inline std::vector<F> sensitivity(const instrument_base<T,F>& i, const curve<T,F>& c)
+	{
+		std::vector<F> df(c.n + 1);
+
+		df[c.n] = sensitivity(i.m,i.u,i.c, c.n,c.t,c.f,c._f, df.data());
+
+		return df;
+	}
+
+	// bumped and shifted views evaluate the underlying curve without copying
+	template<class V, class T, class F>
+	inline F discount(const F& u, const curve_view<V,T,F>& c)
+	{
+		return c.discount(u);
+	}
+
+	template<class V, class T, class F>
+	inline F present_value(const instrument_base<T,F>& i, const curve_view<V,T,F>& c)
+	{
+		return c.present_value(i.m,i.u,i.c);
+	}
+
+	template<class V, class T, class F>
+	inline F duration(const instrument_base<T,F>& i, const curve_view<V,T,F>& c)
+	{
+		return c.duration(i.m,i.u,i.c);
+	}
+
+	// present value, duration, and convexity in one pass
+	template<class T, class F>
+	inline valuation<F> evaluate(const instrument_base<T,F>& i, const curve<T,F>& c)
+	{
+		return evaluate(i.m,i.u,i.c, c.n,c.t,c.f,c._f);
+	}
+
+	// fixed size curves use unrolled evaluation
+	template<size_t N, class T, class F>
+	inline F discount(const F& u, const fixed_curve<N,T,F>& c)
+	{
+		return c.discount(u);
+	}
+
+	template<size_t N, class T, class F>
+	inline F present_value(const instrument_base<T,F>& i, const fixed_curve<N,T,F>& c)
+	{
+		return c.present_value(i.m,i.u,i.c);
+	}
+
+	template<size_t N, class T, class F>
+	inline F duration(const instrument_base<T,F>& i, const fixed_curve<N,T,F>& c)
+	{
+		return c.duration(i.m,i.u,i.c);
+	}
+
 	template<class T = double, class F = double>
 	class forward : public vector_curve<T,F> {
 	public:
@@ -37,10 +97,13 @@ namespace pwflat {
 			: vector_curve<T,F>(t, f, _f)
 		{
 			if (t.size() != f.size())
-				throw std::runtime_error(__FILE__ ": " __FUNCTION__ ": times and forwards must be the same size");
+				throw std::runtime_error(FMS_WHERE + "times and forwards must be the same size");
 		}
 		forward(const forward& f)
-			: forward(f.t_, f.f_, f._f)
+			: vector_curve<T,F>(f)
+		{ }
+		forward(forward&& f) noexcept
+			: vector_curve<T,F>(std::move(f))
 		{ }
 		forward& operator=(const forward& g)
 		{
@@ -50,6 +113,12 @@ namespace pwflat {
 
 			return *this;
 		}
+		forward& operator=(forward&& g) noexcept
+		{
+			vector_curve<T,F>::operator=(std::move(g));
+
+			return *this;
+		}
 		~forward()
 		{ }
 
@@ -58,15 +127,173 @@ namespace pwflat {
 		// extend curve
 		forward& next(const instrument_base<T,F>& i, F p = 0, F e = 0)
 		{
-			e = bootstrap::next(i.m,i.u,i.c, n,t,f, p,e);
+			auto r = try_next(i, p, e);
+			if (r != errc::ok)
+				throw std::runtime_error(FMS_WHERE + message(r));
+
+			return *this;
+		}
+		// leaves the curve unchanged on error
+		errc try_next(const instrument_base<T,F>& i, F p = 0, F e = 0) noexcept
+		{
+			auto r = bootstrap::try_next(i.m,i.u,i.c, this->n,this->t,this->f, p,e);
+			if (!r)
+				return r.error();
+
+			return this->try_push_back(i.last(), *r);
+		}
+
+		// extend curve by k instruments of increasing maturity with prices p[j]
+		// same result as calling next(*i[j], p[j], e) in order, in time linear in the number of instruments
+		// optionally set the k x k jacobian J[j*k + l] of the new forwards wrt p[l]
+		forward& next(size_t k, const instrument_base<T,F>* const* i, const F* p, F e = 0, F* J = nullptr)
+		{
+			auto r = try_next(k, i, p, e, J);
+			if (r != errc::ok)
+				throw std::runtime_error(FMS_WHERE + message(r));
+
+			return *this;
+		}
+		// leaves the curve unchanged on error
+		errc try_next(size_t k, const instrument_base<T,F>* const* i, const F* p, F e = 0, F* J = nullptr) noexcept
+		{
+			try {
+				std::vector<size_t> m(k);
+				std::vector<const T*> u(k);
+				std::vector<const F*> c(k);
+				for (size_t j = 0; j < k; ++j) {
+					m[j] = i[j]->m;
+					u[j] = i[j]->u;
+					c[j] = i[j]->c;
+				}
+
+				size_t n = this->n;
+				small_vector<T> t(this->t_);
+				small_vector<F> f(this->f_);
+				t.resize(n + k);
+				f.resize(n + k);
+				auto r = bootstrap::try_build(k, m.data(), u.data(), c.data(), p, n, t.data(), f.data(), e, J);
+				if (r.second != errc::ok)
+					return r.second;
+
+				this->t_.swap(t);
+				this->f_.swap(f);
+				this->reset();
+			}
+			catch (const std::bad_alloc&) {
+				return errc::out_of_memory;
+			}
+
+			return errc::ok;
+		}
+	};
+
+	// keep instruments, prices, and forwards so a changed quote only re-solves from its pillar on
+	// forwards are identical to a full rebuild with forward::next unless warm starting
+	template<class T = double, class F = double>
+	class bootstrapper {
+		std::vector<vector_instrument<T,F>> i_;
+		std::vector<F> p_;
+		std::vector<T> t_;
+		std::vector<F> f_;
+		std::vector<size_t> k_; // newton iterations used for each pillar
+		size_t n_;              // number of pillars solved with current prices
+		bool warm;              // start newton at the previous forward
+	public:
+		struct statistics {
+			size_t resolved;   // pillars solved
+			size_t reused;     // pillars kept from the previous curve
+			size_t iterations; // newton iterations used
+			size_t saved;      // newton iterations the reused pillars took when last solved
+		} stats;
+
+		bootstrapper(bool warm = false)
+			: n_(0), warm(warm), stats{0, 0, 0, 0}
+		{ }
+
+		size_t size() const
+		{
+			return i_.size();
+		}
+		const vector_instrument<T,F>& instrument(size_t k) const
+		{
+			return i_[k];
+		}
+		F price(size_t k) const
+		{
+			return p_[k];
+		}
+
+		// add an instrument with maturity past the last one
+		bootstrapper& push_back(const instrument_base<T,F>& i, F p = 0)
+		{
+			if (i_.size() > 0 && !(i.last() > i_.back().last()))
+				throw std::runtime_error(FMS_WHERE + "instrument maturities must be increasing");
+
+			i_.push_back(vector_instrument<T,F>(i.m, i.u, i.c));
+			p_.push_back(p);
+			t_.push_back(i.last());
+			f_.push_back(std::numeric_limits<F>::quiet_NaN());
+			k_.push_back(0);
+
+			return *this;
+		}
 
-			push_back(i.last(), e);			
+		// set the price of instrument k
+		bootstrapper& price(size_t k, F p)
+		{
+			if (p != p_[k]) {
+				p_[k] = p;
+				n_ = std::min(n_, k);
+			}
 
 			return *this;
 		}
+
+		// solve pillars with changed prices and every pillar after them
+		pwflat::curve<T,F> curve()
+		{
+			size_t n = size();
+
+			stats.reused += n_;
+			stats.saved += std::accumulate(k_.begin(), k_.begin() + n_, size_t(0));
+
+			for (; n_ < n; ++n_) {
+				const auto& i = i_[n_];
+				size_t k = bootstrap::paths().iterations;
+
+				F e = warm ? f_[n_] : 0;
+				if (std::isnan(e))
+					e = 0;
+				f_[n_] = bootstrap::next(i.m,i.u,i.c, n_,t_.data(),f_.data(), p_[n_],e);
+
+				k_[n_] = bootstrap::paths().iterations - k;
+				++stats.resolved;
+				stats.iterations += k_[n_];
+			}
+
+			return pwflat::curve<T,F>(n, t_.data(), f_.data());
+		}
 	};
 
 } // pwflat
+
+namespace bootstrap {
+
+	// next forward to reprice instrument i at price p given curve c
+	template<class T, class F>
+	inline F next(const instrument_base<T,F>& i, const pwflat::curve<T,F>& c, F p = 0, F _f = 0)
+	{
+		return next(i.m,i.u,i.c, c.n,c.t,c.f, p,_f);
+	}
+
+	template<size_t N, class T, class F>
+	inline F next(const instrument_base<T,F>& i, const pwflat::fixed_curve<N,T,F>& c, F p = 0, F _f = 0)
+	{
+		return next(i, c.view(), p, _f);
+	}
+
+} // bootstrap
 } // fms
 
 #ifdef _DEBUG
@@ -143,17 +370,17 @@ inline void test_fms_forward()
 		double c = 0.05;
 
 		std::vector<double> rc;
-		for (int i = 0; i < sizeof(t) / sizeof(*t); i++) {
+		for (size_t i = 0; i < sizeof(t) / sizeof(*t); i++) {
 			rc.push_back(u(dre) + c);
 		}
 
-		for (int i = 0; i < sizeof(t) / sizeof(*t); i++) {
+		for (size_t i = 0; i < sizeof(t) / sizeof(*t); i++) {
 			// semiannual par bond
 			f.next(instrument::bond<>(t[i], instrument::SEMIANNUAL, rc[i]), 1);
 		}
 		
 		// verify repricing
-		for (int i = 0; i < sizeof(t) / sizeof(*t); i++) {
+		for (size_t i = 0; i < sizeof(t) / sizeof(*t); i++) {
 			auto b =instrument:: bond<>(t[i], instrument::SEMIANNUAL, rc[i]);
 			double pv = pwflat::present_value(b, f);
 			double x; 
@@ -161,6 +388,221 @@ inline void test_fms_forward()
 			assert (fabs(x) < 10*std::numeric_limits<double>::epsilon());
 		}
 	}
+	{ // fixed_curve works with helpers and bootstrap
+		pwflat::forward<> f;
+		double t[] = {1, 2, 3};
+		for (const auto ti : t)
+			f.next(instrument::bond<>(ti, instrument::SEMIANNUAL, 0.05), 1);
+
+		pwflat::fixed_curve<3> c({{f.t[0], f.t[1], f.t[2]}}, {{f.f[0], f.f[1], f.f[2]}});
+		for (const auto ti : t) {
+			auto b = instrument::bond<>(ti, instrument::SEMIANNUAL, 0.05);
+			assert (pwflat::present_value(b, c) == pwflat::present_value(b, f));
+			assert (pwflat::duration(b, c) == pwflat::duration(b, f));
+			assert (pwflat::discount(ti, c) == pwflat::discount(ti, f));
+		}
+
+		auto b = instrument::bond<>(5, instrument::SEMIANNUAL, 0.05);
+		assert (bootstrap::next(b, c, 1.) == bootstrap::next(b, f, 1.));
+	}
+	{ // cds and fras are solved in closed form
+		auto count = bootstrap::paths();
+		pwflat::forward<> f;
+		instrument::cd<> d(0.25, 0.02);
+		instrument::fra<> g(0.25, 0.5, 0.025), h(0.5, 0.75, 0.03);
+
+		f.next(d, 1).next(g, 0).next(h, 0);
+		assert (bootstrap::paths().closed_form == count.closed_form + 3);
+		assert (bootstrap::paths().newton == count.newton);
+		assert (fabs(pwflat::present_value(d, f) - 1) < 2*std::numeric_limits<double>::epsilon());
+		assert (fabs(pwflat::present_value(g, f)) < 2*std::numeric_limits<double>::epsilon());
+		assert (fabs(pwflat::present_value(h, f)) < 2*std::numeric_limits<double>::epsilon());
+	}
+	{ // whole curve bootstrap is identical to chaining next
+		std::default_random_engine dre;
+		std::uniform_real_distribution<> u(-0.01,0.01);
+
+		std::vector<instrument::bond<>> b;
+		std::vector<const instrument_base<>*> pb;
+		std::vector<double> p;
+		for (int i = 1; i <= 30; ++i) {
+			b.push_back(instrument::bond<>(i, instrument::SEMIANNUAL, 0.05 + u(dre)));
+			p.push_back(1 + u(dre));
+		}
+		for (const auto& bi : b)
+			pb.push_back(&bi);
+
+		pwflat::forward<> f, g;
+		for (size_t i = 0; i < b.size(); ++i)
+			f.next(b[i], p[i]);
+		g.next(b.size(), pb.data(), p.data());
+		assert (f == g);
+
+		// extend an existing curve
+		pwflat::forward<> h;
+		h.next(b[0], p[0]).next(b[1], p[1]);
+		h.next(b.size() - 2, pb.data() + 2, p.data() + 2);
+		assert (f == h);
+
+		// failure leaves the curve unchanged
+		try {
+			h.next(1, pb.data(), p.data());
+			assert (false);
+		}
+		catch (const std::exception&) {
+			assert (f == h);
+		}
+	}
+	{ // re-solve from the changed quote
+		std::default_random_engine dre;
+		std::uniform_real_distribution<> u(-0.001,0.001);
+
+		std::vector<instrument::bond<>> b;
+		for (int i = 1; i <= 40; ++i)
+			b.push_back(instrument::bond<>(i, instrument::SEMIANNUAL, 0.05 + u(dre)));
+
+		pwflat::bootstrapper<> s, w(true);
+		for (const auto& bi : b) {
+			s.push_back(bi, 1);
+			w.push_back(bi, 1);
+		}
+		s.curve();
+		w.curve();
+		assert (s.stats.resolved == 40 && s.stats.reused == 0);
+
+		for (int tick = 0; tick < 10; ++tick) {
+			size_t k = 30 + tick;
+			double p = 1 + u(dre);
+			s.price(k, p);
+			w.price(k, p);
+			auto c = s.curve();
+			auto d = w.curve();
+
+			pwflat::forward<> f;
+			for (size_t i = 0; i < b.size(); ++i)
+				f.next(b[i], s.price(i));
+			assert (c == f);
+			for (size_t i = 0; i < c.n; ++i)
+				assert (fabs(d.f[i] - c.f[i]) < 1e-14);
+		}
+		assert (s.stats.resolved == 40 + 55);
+		assert (s.stats.reused == 345);
+		assert (s.stats.saved > 0);
+		assert (w.stats.iterations <= s.stats.iterations);
+
+		s.price(0, s.price(0));
+		s.curve();
+		assert (s.stats.resolved == 95);
+	}
+	{ // error codes instead of exceptions
+		pwflat::forward<> f;
+		auto b1 = instrument::bond<>(1, instrument::SEMIANNUAL, 0.05);
+		auto b2 = instrument::bond<>(2, instrument::SEMIANNUAL, 0.05);
+
+		assert (f.try_next(b2, 1) == errc::ok);
+		auto g(f);
+		assert (f.try_next(b1, 1) == errc::no_cash_flows);
+		assert (f == g);
+		assert (f.try_push_back(2, .05) == errc::not_increasing);
+		assert (f == g);
+		assert (f.try_push_back(3, .05) == errc::ok);
+		assert (f.n == 2);
+
+		const instrument_base<>* i[] = {&b1, &b2};
+		double p[] = {1, 1};
+		pwflat::forward<> h;
+		assert (h.try_next(2, i, p) == errc::ok);
+		assert (h.try_next(2, i, p) == errc::no_cash_flows);
+		assert (h.n == 2);
+		try {
+			h.next(2, i, p);
+			assert (false);
+		}
+		catch (const std::runtime_error& ex) {
+			assert (std::string(ex.what()).find(message(errc::no_cash_flows)) != std::string::npos);
+		}
+
+		// price that cannot be reached
+		auto r = bootstrap::try_next(b2.m, b2.u, b2.c, 0, (const double*)nullptr, (const double*)nullptr, -1.);
+		assert (!r);
+		assert (r.error() == errc::not_converged);
+	}
+	{ // jacobian of forwards wrt prices
+		std::vector<instrument::bond<>> b;
+		std::vector<const instrument_base<>*> pb;
+		std::vector<double> p;
+		for (int i = 1; i <= 10; ++i) {
+			b.push_back(instrument::bond<>(i, instrument::SEMIANNUAL, 0.04 + 0.002*i));
+			p.push_back(1 + 0.001*(i % 3));
+		}
+		for (const auto& bi : b)
+			pb.push_back(&bi);
+		size_t k = b.size();
+
+		std::vector<double> J(k*k);
+		pwflat::forward<> f;
+		f.next(k, pb.data(), p.data(), 0., J.data());
+		assert (f == pwflat::forward<>().next(k, pb.data(), p.data()));
+
+		double h = 1e-6;
+		for (size_t l = 0; l < k; ++l) {
+			std::vector<double> p_(p);
+			p_[l] = p[l] + h;
+			pwflat::forward<> up;
+			up.next(k, pb.data(), p_.data());
+			p_[l] = p[l] - h;
+			pwflat::forward<> dn;
+			dn.next(k, pb.data(), p_.data());
+
+			for (size_t j = 0; j < k; ++j) {
+				double dfdp = (up.f[j] - dn.f[j])/(2*h);
+				assert (fabs(J[j*k + l] - dfdp) < 1e-6);
+				if (j < l)
+					assert (J[j*k + l] == 0);
+			}
+		}
+
+		// par sensitivity of a bond maturing between pillars
+		auto b_ = instrument::bond<>(7.5, instrument::QUARTERLY, 0.05);
+		auto df = pwflat::sensitivity(b_, f);
+		std::vector<double> dp(k);
+		bootstrap::par_sensitivity(k, J.data(), df.data(), dp.data());
+		for (size_t l = 0; l < k; ++l) {
+			std::vector<double> p_(p);
+			p_[l] = p[l] + h;
+			pwflat::forward<> up;
+			up.next(k, pb.data(), p_.data());
+			p_[l] = p[l] - h;
+			pwflat::forward<> dn;
+			dn.next(k, pb.data(), p_.data());
+
+			double dvdp = (pwflat::present_value(b_, up) - pwflat::present_value(b_, dn))/(2*h);
+			assert (fabs(dp[l] - dvdp) < 1e-6);
+		}
+	}
+	{ // key rate sensitivities of a bond
+		pwflat::forward<> f(std::vector<double>{1, 2, 3}, std::vector<double>{.01, .02, .03}, .04);
+		auto b = instrument::bond<>(5, instrument::SEMIANNUAL, 0.05);
+		auto df = pwflat::sensitivity(b, f);
+		assert (df.size() == f.n + 1);
+		assert (fabs(std::accumulate(df.begin(), df.end(), 0.) - pwflat::duration(b, f)) < 1e-12);
+	}
+	{ // key rate scenarios using views agree with sensitivity
+		pwflat::forward<> f(std::vector<double>{1, 2, 3}, std::vector<double>{.01, .02, .03}, .04);
+		auto b = instrument::bond<>(5, instrument::SEMIANNUAL, 0.05);
+		auto df = pwflat::sensitivity(b, f);
+		double h = 1e-6;
+		for (size_t k = 0; k <= f.n; ++k) {
+			double pu = pwflat::present_value(b, pwflat::bumped_curve<>(f, k, h));
+			double pd = pwflat::present_value(b, pwflat::bumped_curve<>(f, k, -h));
+			assert (fabs((pu - pd)/(2*h) - df[k]) < 1e-6);
+		}
+
+		double pu = pwflat::present_value(b, pwflat::shifted_curve<>(f, h));
+		double pd = pwflat::present_value(b, pwflat::shifted_curve<>(f, -h));
+		assert (fabs((pu - pd)/(2*h) - pwflat::duration(b, f)) < 1e-6);
+		assert (pwflat::present_value(b, pwflat::extrapolated_curve<>(f, .04)) == pwflat::present_value(b, f));
+	}
 }
 
 #endif // _DEBUG
\ No newline at end of file
@@ -0,0 +1,112 @@
+// fms_forward_build.h - build independent forward curves in parallel
+/*
+	Each job is a list of instruments of increasing maturity and their prices. Jobs are
+	submitted one at a time to a work stealing pool so a few large curves do not hold up
+	the rest. Results are returned in the order of the jobs with the error message of any
+	job that failed.
+*/
+#pragma once
+#include <string>
+#include <vector>
+#include "fms_forward.h"
+#include "fms_thread_pool.h"
+
+namespace fms {
+namespace pwflat {
+
+	template<class T = double, class F = double>
+	struct curve_job {
+		std::vector<const instrument_base<T,F>*> i; // instruments of increasing maturity
+		std::vector<F> p;                           // prices
+	};
+
+	template<class T = double, class F = double>
+	struct curve_result {
+		forward<T,F> f;
+		bool ok;
+		std::string error; // if not ok
+	};
+
+	// bootstrap each job on the pool and wait for them to finish
+	template<class T, class F>
+	inline std::vector<curve_result<T,F>> build(const std::vector<curve_job<T,F>>& jobs, thread_pool& pool)
+	{
+		std::vector<curve_result<T,F>> r(jobs.size());
+
+		for (size_t j = 0; j < jobs.size(); ++j) {
+			pool.submit([&jobs,&r,j]() {
+				const auto& job = jobs[j];
+				auto& rj = r[j];
+
+				errc e = job.i.size() == job.p.size()
+					? rj.f.try_next(job.i.size(), job.i.data(), job.p.data())
+					: errc::size_mismatch;
+				rj.ok = e == errc::ok;
+				if (!rj.ok)
+					rj.error = message(e);
+			});
+		}
+		pool.wait();
+
+		return r;
+	}
+
+	template<class T, class F>
+	inline std::vector<curve_result<T,F>> build(const std::vector<curve_job<T,F>>& jobs, size_t threads = std::thread::hardware_concurrency())
+	{
+		thread_pool pool(threads);
+
+		return build(jobs, pool);
+	}
+
+} // pwflat
+} // fms
+
+#ifdef _DEBUG
+#include <cassert>
+
+inline void test_fms_forward_build()
+{
+	using namespace fms;
+
+	std::vector<instrument::bond<>> b;
+	for (int i = 1; i <= 30; ++i)
+		b.push_back(instrument::bond<>(i, instrument::SEMIANNUAL, 0.03 + 0.001*i));
+
+	std::vector<pwflat::curve_job<>> jobs(50);
+	for (size_t j = 0; j < jobs.size(); ++j) {
+		size_t k = 1 + (7*j) % b.size(); // uneven sizes
+		for (size_t i = 0; i < k; ++i) {
+			jobs[j].i.push_back(&b[i]);
+			jobs[j].p.push_back(1 + 0.0001*j);
+		}
+	}
+	jobs[3].i.push_back(&b[0]); // maturity not increasing
+	jobs[3].p.push_back(1);
+	jobs[4].p.pop_back();
+
+	fms::thread_pool pool(3);
+	auto r = pwflat::build(jobs, pool);
+	assert (r.size() == jobs.size());
+	for (size_t j = 0; j < jobs.size(); ++j) {
+		if (j == 3 || j == 4) {
+			assert (!r[j].ok);
+			assert (!r[j].error.empty());
+			assert (r[j].f.n == 0);
+
+			continue;
+		}
+
+		pwflat::forward<> f;
+		for (size_t i = 0; i < jobs[j].i.size(); ++i)
+			f.next(*jobs[j].i[i], jobs[j].p[i]);
+		assert (r[j].ok);
+		assert (r[j].f == f);
+	}
+
+	auto r1 = pwflat::build(jobs, 1);
+	for (size_t j = 0; j < jobs.size(); ++j)
+		assert (r1[j].ok == r[j].ok && r1[j].f == r[j].f);
+}
+
+#endif // _DEBUG
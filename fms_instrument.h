@@ -2,7 +2,10 @@
 #pragma once
 #include <cmath>
 #include <algorithm>
+#include <limits>
 #include <vector>
+#include "fms_error.h"
+#include "fms_small_vector.h"
 
 namespace fms {
 
@@ -39,42 +42,70 @@ namespace fms {
 		}
 	};
 
+	// up to 8 cash flows are stored in the object
 	template<class U = double, class C = double>
 	class vector_instrument : public instrument_base<U,C> {
 	protected:
-		std::vector<U> u_;
-		std::vector<C> c_;
+		small_vector<U> u_;
+		small_vector<C> c_;
+
+		static size_t size(const std::vector<U>& u, const std::vector<C>& c)
+		{
+			if (u.size() != c.size())
+				throw std::runtime_error(FMS_WHERE + "cash flow times must equal the number of cash flows");
+
+			return u.size();
+		}
+		// point base members at storage
+		void reset()
+		{
+			instrument_base<U,C>::m = u_.size();
+			instrument_base<U,C>::u = u_.data();
+			instrument_base<U,C>::c = c_.data();
+		}
 	public:
 		vector_instrument(size_t m = 0)
 			: instrument_base<U,C>(m), u_(m), c_(m)
 		{
 			// this must occur after u_, c_ created
-			instrument_base<U,C>::u = u_.data();
-			instrument_base<U,C>::c = c_.data();
+			reset();
 		}
 		vector_instrument(size_t m, const U* u, const C* c)
 			: instrument_base<U,C>(m), u_(u, u + m), c_(c, c + m)
 		{
-			instrument_base<U,C>::u = u_.data();
-			instrument_base<U,C>::c = c_.data();
+			reset();
 		}
 		vector_instrument(const std::vector<U>& u, const std::vector<C>& c)
-			: vector_instrument(u.size(), u.data(), c.data())
+			: vector_instrument<U,C>(size(u, c), u.data(), c.data())
+		{ }
+		vector_instrument(const vector_instrument& i)
+			: instrument_base<U,C>(i.m), u_(i.u_), c_(i.c_)
 		{
-			if (u_.size() != c_.size())
-				throw std::runtime_error(__FILE__ ": " __FUNCTION__ ": cash flow times must equal the number of cash flows");
-
-			instrument_base<U,C>::u = u_.data();
-			instrument_base<U,C>::c = c_.data();
+			reset();
+		}
+		vector_instrument(vector_instrument&& i) noexcept
+			: instrument_base<U,C>(i.m), u_(std::move(i.u_)), c_(std::move(i.c_))
+		{
+			reset();
+			i.reset();
 		}
-		vector_instrument(const vector_instrument& i)
-			: vector_instrument(i.u_, i.c_)
-		{ }
 		vector_instrument& operator=(const vector_instrument& i)
 		{
 			if (this != &i) {
 				u_ = i.u_;
 				c_ = i.c_;
+				reset();
+			}
+
+			return *this;
+		}
+		vector_instrument& operator=(vector_instrument&& i) noexcept
+		{
+			if (this != &i) {
+				u_ = std::move(i.u_);
+				c_ = std::move(i.c_);
+				reset();
+				i.reset();
 			}
 
 			return *this;
@@ -95,19 +126,34 @@ namespace instrument {
 		MONTHLY = 12
 	};
 
+	// number of coupons paid after effective up to termination, counting back from termination
+	// a term within rounding error of a whole number of periods does not get an extra short one,
+	// so termination - k/freq > effective for k < periods
+	// bond, bond_schedule, swap_schedule, and portfolio::push_back all count coupons with this
+	template<class U>
+	inline size_t periods(U effective, U termination, frequency freq)
+	{
+		if (freq == NONE || !(termination > effective))
+			return 0;
+
+		U tol = 16*std::numeric_limits<U>::epsilon()*std::max(std::max(fabs(effective), fabs(termination)), U(1));
+
+		return static_cast<size_t>(ceil(freq*(termination - effective - tol)));
+	}
+
 	// periodic coupons plus notional at maturity
 	// initial price is usually 1 (par)
 	template<class U = double, class C = double>
 	struct bond : public vector_instrument<U,C> {
 		bond(U maturity = 0, frequency freq = NONE, C coupon = 0)
-			: vector_instrument(static_cast<size_t>(ceil(freq*maturity)))
+			: vector_instrument<U,C>(periods(U(0), maturity, freq))
 		{
 			// fill backwards from maturity
 			U i = 0;
-			std::generate(u_.rbegin(), u_.rend(), [&]() { return maturity - i++/freq; });
-			std::fill(c_.begin(), c_.end(), coupon/freq);
+			std::generate(this->u_.rbegin(), this->u_.rend(), [&]() { return maturity - i++/freq; });
+			std::fill(this->c_.begin(), this->c_.end(), coupon/freq);
 
-			c_.back() += 1; // plus unit notional at maturity
+			this->c_.back() += 1; // plus unit notional at maturity
 		}
 	};
 
@@ -116,17 +162,24 @@ namespace instrument {
 	template<class U = double, class C = double>
 	struct cd : public vector_instrument<U,C> {
 		cd(U maturity = 0, C coupon = 0)
-			: vector_instrument(1)
+			: vector_instrument<U,C>(1)
 		{
-			u_[0] = maturity;
-			c_[0] = 1 + coupon*maturity;
+			this->u_[0] = maturity;
+			this->c_[0] = 1 + coupon*maturity;
 		}
 	};
 	// foward rate agreement with two cash flows: -1 at u and 1 + c(v-u) at v
 	// initial price is usually 0
 	template<class U = double, class C = double>
 	struct fra : public vector_instrument<U,C> {
-		// !!! implement here
+		fra(U effective = 0, U termination = 0, C coupon = 0)
+			: vector_instrument<U,C>(2)
+		{
+			this->u_[0] = effective;
+			this->c_[0] = -1;
+			this->u_[1] = termination;
+			this->c_[1] = 1 + coupon*(termination - effective);
+		}
 	};
 } // instrument
 } // fms
@@ -163,10 +216,55 @@ inline void test_fms_instrument()
 		assert (!(b != b2));
 	}
 	{
-		//!!! test fms::instrument::cd
+		cd<> d(0.25, 0.02);
+		assert (d.m == 1);
+		assert (d.u[0] == 0.25);
+		assert (d.c[0] == 1 + 0.02*0.25);
+		assert (d.last() == 0.25);
 	}
 	{
-		//!!! test fms::instrument::fra
+		fra<> f(0.25, 0.5, 0.03);
+		assert (f.m == 2);
+		assert (f.u[0] == 0.25 && f.u[1] == 0.5);
+		assert (f.c[0] == -1);
+		assert (f.c[1] == 1 + 0.03*0.25);
+		assert (f.last() == 0.5);
+	}
+	{ // assignment points at the new cash flows
+		bond<> b(2, QUARTERLY, 0.01);
+		vector_instrument<> i(cd<>(0.25, 0.02));
+		i = b;
+		assert (i == b && i.m == 8);
+		i = cd<>(0.5, 0.03);
+		assert (i == cd<>(0.5, 0.03) && i.m == 1);
+	}
+	{ // up to 8 cash flows do not allocate
+		size_t a = small_vector_allocations();
+		cd<> d(0.25, 0.02);
+		fra<> f(0.25, 0.5, 0.03);
+		bond<> b(4, SEMIANNUAL, 0.05);
+		assert (small_vector_allocations() == a);
+
+		bond<> b30(30, SEMIANNUAL, 0.05);
+		assert (small_vector_allocations() == a + 2);
+
+		// moves steal the heap arrays
+		bond<> b1(std::move(b30));
+		assert (b1.m == 60 && b30.m == 0);
+		vector_instrument<> i;
+		i = std::move(b1);
+		assert (i.m == 60 && i.u[59] == 30 && i.c[59] == 1 + 0.05/2);
+		assert (small_vector_allocations() == a + 2);
+
+		// moves of inline storage copy the cash flows and point at them
+		cd<> d1(std::move(d));
+		assert (d1 == cd<>(0.25, 0.02) && d.m == 0);
+		std::vector<bond<>> v;
+		v.reserve(2);
+		v.push_back(bond<>(3, ANNUAL, 0.04));
+		v.push_back(std::move(b));
+		assert (v[1] == bond<>(4, SEMIANNUAL, 0.05));
+		assert (small_vector_allocations() == a + 2);
 	}
 }
 
@@ -7,6 +7,8 @@ phi[i] is the futures over (t[i-1],t[i]] for i > 0
 #pragma once
 #include <cmath>
 #include <random>
+#include <stdexcept>
+#include "fms_error.h"
 #include "fms_forward.h"
 
 namespace fms {
@@ -24,9 +26,8 @@ namespace pwflat {
 		lmm(const std::vector<T>& t, const std::vector<F>& phi, const std::vector<F>& sigma, const std::vector<F>& theta)
 			: s0(0), gamma_(5e-4/25), t(t), phi(phi), sigma(sigma), theta(theta)
 		{
-			ensure (t.size() == phi.size());
-			ensure (t.size() == sigma.size());
-			ensure (t.size() == theta.size());
+			if (t.size() != phi.size() || t.size() != sigma.size() || t.size() != theta.size())
+				throw std::runtime_error(FMS_WHERE + "times, futures, volatilities and correlations must be the same size");
 		}
 
 		lmm(const lmm&) = default;
@@ -53,7 +54,8 @@ namespace pwflat {
 		lmm& advance(const T& s)
 		{
 			// curve already evolved to s0
-			ensure (s > s0);
+			if (!(s > s0))
+				throw std::runtime_error(FMS_WHERE + "calendar time must increase");
 			T ds = s - s0;
 			T sqrtds = sqrt(ds);
 
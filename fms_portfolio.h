@@ -0,0 +1,200 @@
+// fms_portfolio.h - instruments stored in flat arrays
+/*
+	Cash flow times and amounts of all instruments are stored one after another in two arrays
+	and instrument k has cash flows off[k] <= j < off[k + 1] (compressed sparse row). Views of
+	an instrument point into the arrays so nothing is copied. Appending may move the arrays
+	and invalidates views.
+*/
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <vector>
+#include "fms_instrument.h"
+
+namespace fms {
+
+	// instrument pointing at memory it does not own that can be copied
+	template<class U = double, class C = double>
+	struct instrument_view : public instrument_base<U,C> {
+		instrument_view(size_t m = 0, const U* u = nullptr, const C* c = nullptr)
+			: instrument_base<U,C>(m, u, c)
+		{ }
+		instrument_view(const instrument_view& i)
+			: instrument_base<U,C>(i.m, i.u, i.c)
+		{ }
+		instrument_view& operator=(const instrument_view& i)
+		{
+			instrument_base<U,C>::m = i.m;
+			instrument_base<U,C>::u = i.u;
+			instrument_base<U,C>::c = i.c;
+
+			return *this;
+		}
+	};
+
+	template<class U = double, class C = double>
+	class portfolio {
+		std::vector<U> u_;        // times of all cash flows
+		std::vector<C> c_;        // amounts of all cash flows
+		std::vector<size_t> off_; // instrument k has cash flows [off_[k], off_[k + 1])
+
+		// append x[0], ..., x[m-1] to v where x may point into v
+		template<class X>
+		static void append(std::vector<X>& v, size_t m, const X* x)
+		{
+			size_t n = v.size();
+			if (std::less_equal<const X*>()(v.data(), x) && std::less<const X*>()(x, v.data() + n)) {
+				size_t j = x - v.data(); // x is invalid if v reallocates
+				v.resize(n + m);
+				std::copy(v.begin() + j, v.begin() + j + m, v.begin() + n);
+			}
+			else {
+				v.insert(v.end(), x, x + m);
+			}
+		}
+	public:
+		portfolio()
+			: off_(1, 0)
+		{ }
+
+		// number of instruments
+		size_t size() const
+		{
+			return off_.size() - 1;
+		}
+		// number of cash flows of all instruments
+		size_t cash_flows() const
+		{
+			return u_.size();
+		}
+		// bytes allocated
+		size_t bytes() const
+		{
+			return u_.capacity()*sizeof(U) + c_.capacity()*sizeof(C) + off_.capacity()*sizeof(size_t);
+		}
+
+		const U* times() const
+		{
+			return u_.data();
+		}
+		const C* amounts() const
+		{
+			return c_.data();
+		}
+		const size_t* offsets() const
+		{
+			return off_.data();
+		}
+
+		instrument_view<U,C> operator[](size_t k) const
+		{
+			return instrument_view<U,C>(off_[k + 1] - off_[k], u_.data() + off_[k], c_.data() + off_[k]);
+		}
+
+		void reserve(size_t instruments, size_t cash_flows)
+		{
+			off_.reserve(instruments + 1);
+			u_.reserve(cash_flows);
+			c_.reserve(cash_flows);
+		}
+
+		// u and c may point into the portfolio, e.g. push_back(p[k])
+		portfolio& push_back(size_t m, const U* u, const C* c)
+		{
+			append(u_, m, u);
+			append(c_, m, c);
+			off_.push_back(u_.size());
+
+			return *this;
+		}
+		portfolio& push_back(const instrument_base<U,C>& i)
+		{
+			return push_back(i.m, i.u, i.c);
+		}
+
+		// append n bonds with the same cash flows as instrument::bond(maturity[k], freq, coupon[k])
+		portfolio& push_back(size_t n, const U* maturity, instrument::frequency freq, const C* coupon)
+		{
+			size_t m = cash_flows();
+			for (size_t k = 0; k < n; ++k)
+				m += instrument::periods(U(0), maturity[k], freq);
+			reserve(size() + n, m);
+
+			for (size_t k = 0; k < n; ++k) {
+				size_t mk = instrument::periods(U(0), maturity[k], freq);
+				size_t j = u_.size();
+
+				u_.resize(j + mk);
+				c_.resize(j + mk, coupon[k]/freq);
+				// fill backwards from maturity
+				U i = 0;
+				for (size_t l = j + mk; l > j; --l)
+					u_[l - 1] = maturity[k] - i++/freq;
+				if (mk > 0)
+					c_.back() += 1; // plus unit notional at maturity
+
+				off_.push_back(u_.size());
+			}
+
+			return *this;
+		}
+	};
+
+} // fms
+
+#ifdef _DEBUG
+#include <cassert>
+
+inline void test_fms_portfolio()
+{
+	using namespace fms;
+
+	portfolio<> p;
+	assert (p.size() == 0 && p.cash_flows() == 0);
+
+	double t[] = {1, 2.25, 3, 0.5, 10};
+	double c[] = {0.01, 0.02, 0.03, 0.04, 0.05};
+	p.push_back(5, t, instrument::SEMIANNUAL, c);
+	assert (p.size() == 5);
+
+	size_t m = 0;
+	for (size_t k = 0; k < 5; ++k) {
+		instrument::bond<> b(t[k], instrument::SEMIANNUAL, c[k]);
+		auto v = p[k];
+		assert (v == b);
+		assert (v.last() == b.last());
+		m += b.m;
+	}
+	assert (p.cash_flows() == m);
+
+	instrument::cd<> d(0.25, 0.02);
+	p.push_back(d);
+	assert (p.size() == 6);
+	assert (p[5] == d);
+	assert (p[0] == instrument::bond<>(t[0], instrument::SEMIANNUAL, c[0]));
+
+	// views copy and point at the same memory
+	auto v = p[2];
+	instrument_view<> w(v);
+	assert (w.u == v.u && w.c == v.c && w.m == v.m);
+	w = p[3];
+	assert (w == p[3]);
+
+	assert (p.offsets()[0] == 0 && p.offsets()[p.size()] == p.cash_flows());
+	assert (p.bytes() >= p.cash_flows()*2*sizeof(double));
+
+	// re-adding an instrument of the portfolio while its arrays reallocate
+	for (size_t k = 0; k < 100; ++k) {
+		size_t j = k % 6;
+		p.push_back(p[j]);
+		if (j == 5)
+			assert (p[p.size() - 1] == d);
+		else
+			assert (p[p.size() - 1] == instrument::bond<>(t[j], instrument::SEMIANNUAL, c[j]));
+	}
+	assert (p.size() == 106);
+	assert (p.offsets()[p.size()] == p.cash_flows());
+}
+
+#endif // _DEBUG
@@ -0,0 +1,306 @@
+// fms_portfolio_delta.h - update values when one forward changes
+/*
+	Changing f[i] by df multiplies the discount at every date past t[i] by exp(-df*(t[i] - t[i-1]))
+	and changes discounts in segment i by different factors. The cash flows of each instrument
+	are grouped by segment and the pricer keeps the present value and duration of every group
+	with a scale for each segment. Groups in segment i are recomputed from their cash flows,
+	the scales of later segments are multiplied by the common factor, and only instruments having
+	cash flows past t[i-1] are summed again.
+
+	Scaling rounds differently than discounting from scratch so values agree with present_value
+	to a few ulps per change. Call value(curve) to reprice everything exactly. A change to an early
+	forward touches almost every group and is slower than that.
+*/
+#pragma once
+#include <algorithm>
+#include <vector>
+#include "fms_portfolio_pricer.h"
+
+namespace fms {
+namespace pwflat {
+
+	template<class T = double, class F = double>
+	class incremental_pricer : public pricing_plan<T,F> {
+		typedef portfolio_pricer<T,F> base;
+		typedef pricing_plan<T,F> plan;
+
+		std::vector<F> f_;          // current forwards
+		F _f;                       // current extrapolation
+		std::vector<size_t> gj_;    // date of cash flows of each instrument ordered by segment
+		std::vector<F> gc_;         // and their amounts
+		std::vector<size_t> goff_;  // group g has cash flows [goff_[g], goff_[g + 1])
+		std::vector<size_t> gs_;    // segment of group g
+		std::vector<size_t> koff_;  // instrument k has groups [koff_[k], koff_[k + 1])
+		std::vector<size_t> soff_;  // segment i has groups sg_[soff_[i]], ..., sg_[soff_[i + 1] - 1]
+		std::vector<size_t> sg_;
+		std::vector<size_t> ks_;    // instruments by decreasing last segment
+		std::vector<size_t> kn_;    // ks_[0], ..., ks_[kn_[i] - 1] have cash flows in segments i or later
+		std::vector<F> gpv_, gdur_; // value and duration of each group before scaling
+		std::vector<F> a_;          // scale of the groups in each segment
+		std::vector<F> pv_, dur_;   // value and duration of each instrument
+		size_t touched_;
+		size_t grouped_;            // value of plan::rebuilds() the groups were made for
+
+		// segment of cash flow l
+		size_t segment(size_t l) const
+		{
+			return plan::i_[base::j_[l]];
+		}
+
+		void group()
+		{
+			size_t K = base::size();
+			size_t n = plan::t_.size();
+
+			std::vector<size_t> l(base::c_.size());
+			gj_.resize(l.size());
+			gc_.resize(l.size());
+			goff_.assign(1, 0);
+			gs_.clear();
+			koff_.assign(1, 0);
+			for (size_t k = 0; k < K; ++k) {
+				size_t b = base::off_[k], e = base::off_[k + 1];
+				for (size_t m = b; m < e; ++m)
+					l[m] = m;
+				std::stable_sort(l.begin() + b, l.begin() + e, [this](size_t x, size_t y) { return segment(x) < segment(y); });
+				for (size_t m = b; m < e; ++m) {
+					gj_[m] = base::j_[l[m]];
+					gc_[m] = base::c_[l[m]];
+					if (m + 1 == e || segment(l[m]) != segment(l[m + 1])) {
+						goff_.push_back(m + 1);
+						gs_.push_back(segment(l[m]));
+					}
+				}
+				koff_.push_back(gs_.size());
+			}
+
+			// groups by segment
+			size_t G = gs_.size();
+			soff_.assign(n + 2, 0);
+			for (size_t g = 0; g < G; ++g)
+				++soff_[gs_[g] + 1];
+			for (size_t i = 0; i <= n; ++i)
+				soff_[i + 1] += soff_[i];
+			sg_.resize(G);
+			std::vector<size_t> next(soff_.begin(), soff_.end() - 1);
+			for (size_t g = 0; g < G; ++g)
+				sg_[next[gs_[g]]++] = g;
+
+			// instruments by last segment
+			ks_.clear();
+			kn_.assign(n + 2, 0);
+			for (size_t k = 0; k < K; ++k)
+				if (koff_[k] < koff_[k + 1])
+					ks_.push_back(k);
+			auto last = [this](size_t k) { return gs_[koff_[k + 1] - 1]; };
+			std::stable_sort(ks_.begin(), ks_.end(), [&last](size_t x, size_t y) { return last(x) > last(y); });
+			for (size_t k : ks_)
+				++kn_[last(k)];
+			for (size_t i = n + 1; i-- > 0; )
+				kn_[i] += kn_[i + 1];
+
+			gpv_.resize(G);
+			gdur_.resize(G);
+			a_.resize(n + 1);
+			grouped_ = plan::rebuilds();
+		}
+
+		// value group g from the discounts at its dates
+		void value_group(size_t g)
+		{
+			const T* u = base::u_.data();
+			const F* D = base::D_.data();
+			F p{0}, d{0};
+
+			for (size_t l = goff_[g]; l < goff_[g + 1]; ++l) {
+				size_t j = gj_[l];
+				p += gc_[l]*D[j];
+				d -= u[j]*gc_[l]*D[j];
+			}
+			gpv_[g] = p;
+			gdur_[g] = d;
+		}
+		void sum(size_t k)
+		{
+			F p{0}, d{0};
+
+			for (size_t g = koff_[k]; g < koff_[k + 1]; ++g) {
+				p += a_[gs_[g]]*gpv_[g];
+				d += a_[gs_[g]]*gdur_[g];
+			}
+			pv_[k] = p;
+			dur_[k] = d;
+		}
+
+		// f[i] or, if i is n, _f changed by df
+		void update(size_t i, const F& df)
+		{
+			size_t n = f_.size();
+
+			// discounts past segment i are scaled
+			if (i < n) {
+				F a = exp(-df*plan::h_[i]);
+				for (size_t s = i + 1; s <= n; ++s)
+					a_[s] *= a;
+			}
+
+			// discounts in segment i are computed again
+			plan::integrals(n, f_.data());
+			auto js = std::equal_range(plan::i_.begin(), plan::i_.end(), i);
+			for (auto j = js.first; j != js.second; ++j)
+				base::D_[j - plan::i_.begin()] = plan::discount(j - plan::i_.begin(), n, f_.data(), _f);
+			for (size_t s = soff_[i]; s < soff_[i + 1]; ++s)
+				value_group(sg_[s]);
+			a_[i] = 1;
+
+			touched_ = kn_[i];
+			for (size_t k = 0; k < touched_; ++k)
+				sum(ks_[k]);
+		}
+	public:
+		incremental_pricer(const curve<T,F>& c, const portfolio<T,F>& p)
+			: plan(c, p), touched_(0), grouped_(0)
+		{
+			value(c);
+		}
+		incremental_pricer(const curve<T,F>& c, size_t n, const instrument_base<T,F>* const* i)
+			: plan(c, n, i), touched_(0), grouped_(0)
+		{
+			value(c);
+		}
+		incremental_pricer(const curve<T,F>& c, const instrument_base<T,F>& i)
+			: incremental_pricer(c, 1, std::vector<const instrument_base<T,F>*>(1, &i).data())
+		{ }
+
+		// reprice everything on the curve
+		void value(const curve<T,F>& c)
+		{
+			f_.assign(c.f, c.f + c.n);
+			_f = c._f;
+			pv_.resize(base::size());
+			dur_.resize(base::size());
+			plan::value(c, pv_.data(), dur_.data());
+			if (grouped_ != plan::rebuilds())
+				group();
+			for (size_t g = 0; g < gs_.size(); ++g)
+				value_group(g);
+			std::fill(a_.begin(), a_.end(), F(1));
+		}
+
+		const F& forward(size_t i) const
+		{
+			return f_[i];
+		}
+		void forward(size_t i, const F& fi)
+		{
+			F df = fi - f_[i];
+			f_[i] = fi;
+			update(i, df);
+		}
+		const F& extrapolate() const
+		{
+			return _f;
+		}
+		void extrapolate(const F& f)
+		{
+			F df = f - _f;
+			_f = f;
+			update(f_.size(), df);
+		}
+
+		// current value and duration of instrument k
+		const F& present_value(size_t k) const
+		{
+			return pv_[k];
+		}
+		const F& duration(size_t k) const
+		{
+			return dur_[k];
+		}
+		// number of instruments summed again in the last update
+		size_t touched() const
+		{
+			return touched_;
+		}
+	};
+
+} // pwflat
+} // fms
+
+#ifdef _DEBUG
+#include <cassert>
+#include <cmath>
+#include "fms_forward.h"
+
+inline void test_fms_portfolio_delta()
+{
+	using namespace fms;
+
+	std::vector<double> t{1, 2, 3, 5, 7, 10}, f{.01, .015, .02, .025, .03, .035};
+	double _f = .04;
+
+	portfolio<> p;
+	std::vector<double> mat, cpn;
+	for (int k = 1; k <= 48; ++k) {
+		mat.push_back(0.25*k);
+		cpn.push_back(0.02 + 0.001*(k % 5));
+	}
+	p.push_back(mat.size(), mat.data(), instrument::SEMIANNUAL, cpn.data());
+	p.push_back(instrument::cd<>(0.5, 0.02));
+
+	pwflat::incremental_pricer<> q(pwflat::vector_curve<>(t, f, _f), p);
+	auto check = [&](double tol) {
+		pwflat::vector_curve<> c(t, f, _f);
+		for (size_t k = 0; k < p.size(); ++k) {
+			double pv = pwflat::present_value(p[k], c);
+			double dur = pwflat::duration(p[k], c);
+			assert (fabs(q.present_value(k) - pv) <= tol*fabs(pv));
+			assert (fabs(q.duration(k) - dur) <= tol*fabs(dur));
+		}
+	};
+	check(0);
+
+	// forward in the middle changes
+	f[3] += .001;
+	q.forward(3, f[3]);
+	assert (q.forward(3) == f[3]);
+	check(1e-14);
+	// bonds maturing before t[2] are not summed
+	assert (q.touched() < p.size());
+	for (size_t k = 0; k < p.size(); ++k)
+		if (p[k].last() <= t[2])
+			assert (q.present_value(k) == pwflat::present_value(p[k], pwflat::vector_curve<>(t, f, _f)));
+
+	f[0] -= .002;
+	q.forward(0, f[0]);
+	_f = .05;
+	q.extrapolate(_f);
+	assert (q.extrapolate() == _f);
+	for (size_t i = 0; i < 20; ++i) {
+		size_t j = (7*i) % t.size();
+		f[j] += 0.0001*(i % 3 ? 1 : -2);
+		q.forward(j, f[j]);
+	}
+	check(1e-13);
+
+	q.value(pwflat::vector_curve<>(t, f, _f));
+	check(0);
+
+	// new curve times regroup the cash flows
+	pwflat::vector_curve<> g(std::vector<double>{0.5, 4}, std::vector<double>{.02, .03}, .035);
+	q.value(g);
+	t = {0.5, 4}; f = {.02, .03}; _f = .035;
+	check(0);
+	f[1] = .025;
+	q.forward(1, f[1]);
+	check(1e-14);
+
+	// single instrument
+	instrument::bond<> b(7, instrument::QUARTERLY, .03);
+	pwflat::incremental_pricer<> r(g, b);
+	r.forward(0, .021);
+	pwflat::vector_curve<> g1(std::vector<double>{0.5, 4}, std::vector<double>{.021, .03}, .035);
+	assert (fabs(r.present_value(0) - pwflat::present_value(b, g1)) <= 1e-14);
+}
+
+#endif // _DEBUG
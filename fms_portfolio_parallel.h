@@ -0,0 +1,262 @@
+// fms_portfolio_parallel.h - value instruments on a thread pool
+/*
+	Instruments are split into chunks of consecutive instruments having about the same number
+	of cash flows, so a chunk of one year deposits costs as much as a chunk of thirty year bonds.
+	Chunks are submitted to a work stealing pool and each computes the sum of its values.
+	The totals add the chunk sums in chunk order. Chunks depend only on the instruments, not the
+	number of threads, so totals are identical for any pool. value() may be called from several
+	threads at once, on the same pool or not, and stats() reports the call that finished last.
+
+	Threads that are not workers of the pool share the last slot of busy and runs. When calls share
+	a pool the caller of one may run chunks of another, stolen counts steals by every task run on
+	the pool during the call, and wait() rethrows the first exception of any of its tasks.
+*/
+#pragma once
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include "fms_curve.h"
+#include "fms_portfolio.h"
+#include "fms_thread_pool.h"
+
+namespace fms {
+namespace pwflat {
+
+	template<class F = double>
+	struct portfolio_total {
+		F pv;       // sum of present values
+		F duration; // sum of durations
+	};
+
+	// time each thread spent valuing in the last call
+	struct utilization {
+		double wall;              // seconds from first submit to last chunk done
+		std::vector<double> busy; // seconds valuing by each worker and, last, the calling thread
+		std::vector<size_t> runs; // chunks run by each
+		size_t stolen;            // tasks run by a worker that stole them
+
+		// busy[w]/wall
+		double operator[](size_t w) const
+		{
+			return wall > 0 ? busy[w]/wall : 0;
+		}
+	};
+
+	template<class T = double, class F = double>
+	class parallel_pricer {
+		std::vector<instrument_view<T,F>> i_;
+		std::vector<size_t> off_; // chunk c has instruments [off_[c], off_[c + 1])
+		mutable std::mutex m_;
+		utilization u_;           // last call to value
+
+		// split into chunks of about cost cash flows, counting each instrument as one more
+		void chunk(size_t cost)
+		{
+			off_.assign(1, 0);
+			size_t w = 0;
+			for (size_t k = 0; k < i_.size(); ++k) {
+				w += i_[k].m + 1;
+				if (w >= cost || k + 1 == i_.size()) {
+					off_.push_back(k + 1);
+					w = 0;
+				}
+			}
+		}
+	public:
+		parallel_pricer(size_t n, const instrument_base<T,F>* const* i, size_t cost = 4096)
+		{
+			for (size_t k = 0; k < n; ++k)
+				i_.push_back(instrument_view<T,F>(i[k]->m, i[k]->u, i[k]->c));
+			chunk(cost);
+		}
+		// p must outlive the pricer and not be appended to
+		parallel_pricer(const portfolio<T,F>& p, size_t cost = 4096)
+		{
+			for (size_t k = 0; k < p.size(); ++k)
+				i_.push_back(p[k]);
+			chunk(cost);
+		}
+
+		size_t size() const
+		{
+			return i_.size();
+		}
+		size_t chunks() const
+		{
+			return off_.size() - 1;
+		}
+		utilization stats() const
+		{
+			std::lock_guard<std::mutex> lock(m_);
+
+			return u_;
+		}
+
+		// totals and, if not null, values of each instrument
+		portfolio_total<F> value(const curve<T,F>& c, thread_pool& pool, F* pv = nullptr, F* dur = nullptr)
+		{
+			typedef std::chrono::steady_clock clock;
+
+			size_t W = pool.size() + 1;
+			std::vector<portfolio_total<F>> sum(chunks());
+			std::vector<double> busy(W, 0);
+			std::vector<size_t> runs(W, 0);
+			std::mutex m; // slot of threads that are not workers
+			size_t stolen = pool.stolen();
+
+			auto t0 = clock::now();
+			for (size_t j = 0; j < chunks(); ++j) {
+				pool.submit([this,&c,&pool,&sum,&busy,&runs,&m,pv,dur,j]() {
+					auto s = clock::now();
+
+					portfolio_total<F> t{0, 0};
+					for (size_t k = off_[j]; k < off_[j + 1]; ++k) {
+						const auto& i = i_[k];
+						auto v = evaluate(i.m, i.u, i.c, c.n, c.t, c.f, c._f);
+						t.pv += v.pv;
+						t.duration += v.duration;
+						if (pv)
+							pv[k] = v.pv;
+						if (dur)
+							dur[k] = v.duration;
+					}
+					sum[j] = t;
+
+					double b = std::chrono::duration<double>(clock::now() - s).count();
+					size_t w = pool.worker();
+					if (w < pool.size()) { // only this thread writes slot w
+						busy[w] += b;
+						++runs[w];
+					}
+					else {
+						std::lock_guard<std::mutex> lock(m);
+						busy[w] += b;
+						++runs[w];
+					}
+				});
+			}
+			pool.wait();
+
+			double wall = std::chrono::duration<double>(clock::now() - t0).count();
+			{
+				std::lock_guard<std::mutex> lock(m_);
+				u_.wall = wall;
+				u_.busy.swap(busy);
+				u_.runs.swap(runs);
+				u_.stolen = pool.stolen() - stolen;
+			}
+
+			portfolio_total<F> t{0, 0};
+			for (const auto& s : sum) {
+				t.pv += s.pv;
+				t.duration += s.duration;
+			}
+
+			return t;
+		}
+	};
+
+} // pwflat
+} // fms
+
+#ifdef _DEBUG
+#include <cassert>
+#include "fms_forward.h"
+
+inline void test_fms_portfolio_parallel()
+{
+	using namespace fms;
+
+	pwflat::vector_curve<> f(std::vector<double>{1, 2, 3, 5, 7, 10}, std::vector<double>{.01, .015, .02, .025, .03, .035}, .04);
+
+	// deposits and monthly bonds
+	portfolio<> p;
+	for (int k = 1; k <= 300; ++k) {
+		if (k % 3) {
+			p.push_back(instrument::cd<>(k/360., 0.02));
+		}
+		else {
+			double t = k/30., c = 0.03;
+			p.push_back(1, &t, instrument::MONTHLY, &c);
+		}
+	}
+
+	pwflat::parallel_pricer<> q(p, 64);
+	assert (q.size() == p.size());
+	assert (q.chunks() > 10);
+
+	std::vector<double> pv(p.size()), dur(p.size());
+	pwflat::portfolio_total<> t1;
+	{
+		fms::thread_pool pool(1);
+		t1 = q.value(f, pool, pv.data(), dur.data());
+	}
+	for (size_t k = 0; k < p.size(); ++k) {
+		assert (pv[k] == pwflat::present_value(p[k], f));
+		assert (dur[k] == pwflat::duration(p[k], f));
+	}
+
+	for (size_t n : {2, 3, 4}) {
+		fms::thread_pool pool(n);
+		auto t = q.value(f, pool);
+		assert (t.pv == t1.pv && t.duration == t1.duration);
+
+		const auto& u = q.stats();
+		assert (u.busy.size() == n + 1 && u.runs.size() == n + 1);
+		size_t runs = 0;
+		for (size_t w = 0; w <= n; ++w) {
+			runs += u.runs[w];
+			assert (u[w] >= 0 && u[w] <= 1);
+		}
+		assert (runs == q.chunks());
+	}
+
+	std::vector<const instrument_base<>*> i;
+	std::vector<instrument_view<>> v;
+	for (size_t k = 0; k < p.size(); ++k)
+		v.push_back(p[k]);
+	for (const auto& vk : v)
+		i.push_back(&vk);
+	pwflat::parallel_pricer<> r(i.size(), i.data(), 64);
+	fms::thread_pool pool(2);
+	auto t = r.value(f, pool);
+	assert (t.pv == t1.pv && t.duration == t1.duration);
+
+	// concurrent calls on one pricer
+	{
+		fms::thread_pool p1(2), p2(2);
+		pwflat::portfolio_total<> a, b;
+		std::vector<double> pa(p.size()), pb(p.size());
+		std::thread x([&]() { a = q.value(f, p1, pa.data()); });
+		b = q.value(f, p2, pb.data());
+		x.join();
+		assert (a.pv == t1.pv && a.duration == t1.duration);
+		assert (b.pv == t1.pv && b.duration == t1.duration);
+		assert (pa == pv && pb == pv);
+	}
+
+	// concurrent calls on one pool
+	{
+		fms::thread_pool pool(2);
+		std::vector<pwflat::portfolio_total<>> a(4);
+		std::vector<std::vector<double>> pa(a.size(), std::vector<double>(p.size()));
+		std::vector<std::thread> x;
+		for (size_t j = 1; j < a.size(); ++j)
+			x.emplace_back([&,j]() { a[j] = q.value(f, pool, pa[j].data()); });
+		a[0] = q.value(f, pool, pa[0].data());
+		for (auto& xj : x)
+			xj.join();
+		for (size_t j = 0; j < a.size(); ++j) {
+			assert (a[j].pv == t1.pv && a[j].duration == t1.duration);
+			assert (pa[j] == pv);
+		}
+
+		const auto& u = q.stats();
+		size_t runs = 0;
+		for (size_t w = 0; w <= pool.size(); ++w)
+			runs += u.runs[w];
+		assert (runs == q.chunks());
+	}
+}
+
+#endif // _DEBUG
@@ -0,0 +1,276 @@
+// fms_portfolio_pricer.h - value many instruments on one curve
+/*
+	Most cash flows of a large book fall on a few thousand dates. The pricer sorts the
+	distinct cash flow times once and maps every cash flow to its date. Valuing on a curve
+	computes the discount at each date with one sweep over the curve and the present value
+	and duration of each instrument are sums of amounts times gathered discounts.
+
+	Discounts are computed with the same operations as pwflat::present_value, so values agree exactly.
+
+	When only the forwards change a pricing_plan also caches the curve segment of each date and
+	its distance from the start of the segment. Repricing takes prefix sums of the forwards
+	and one exp per date. The plan is rebuilt if it is used with a curve having different times.
+*/
+#pragma once
+#include <algorithm>
+#include <vector>
+#include "fms_curve.h"
+#include "fms_portfolio.h"
+
+namespace fms {
+namespace pwflat {
+
+	template<class T = double, class F = double>
+	class portfolio_pricer {
+	protected:
+		std::vector<T> u_;        // distinct sorted cash flow times
+		std::vector<size_t> j_;   // date of each cash flow
+		std::vector<F> c_;        // cash flow amounts
+		std::vector<size_t> off_; // instrument k has cash flows [off_[k], off_[k + 1])
+		std::vector<F> D_;        // discount at each date
+
+		// map times to dates
+		void index(const T* u)
+		{
+			size_t m = c_.size();
+
+			u_.assign(u, u + m);
+			std::sort(u_.begin(), u_.end());
+			u_.erase(std::unique(u_.begin(), u_.end()), u_.end());
+
+			j_.resize(m);
+			for (size_t j = 0; j < m; ++j)
+				j_[j] = std::lower_bound(u_.begin(), u_.end(), u[j]) - u_.begin();
+			D_.resize(u_.size());
+		}
+	public:
+		portfolio_pricer()
+			: off_(1, 0)
+		{ }
+		// n instruments
+		portfolio_pricer(size_t n, const instrument_base<T,F>* const* i)
+			: off_(1, 0)
+		{
+			std::vector<T> u;
+			for (size_t k = 0; k < n; ++k) {
+				u.insert(u.end(), i[k]->u, i[k]->u + i[k]->m);
+				c_.insert(c_.end(), i[k]->c, i[k]->c + i[k]->m);
+				off_.push_back(c_.size());
+			}
+			index(u.data());
+		}
+		explicit portfolio_pricer(const portfolio<T,F>& p)
+			: c_(p.amounts(), p.amounts() + p.cash_flows()), off_(p.offsets(), p.offsets() + p.size() + 1)
+		{
+			index(p.times());
+		}
+
+		// number of instruments
+		size_t size() const
+		{
+			return off_.size() - 1;
+		}
+		// number of distinct cash flow times
+		size_t dates() const
+		{
+			return u_.size();
+		}
+		const T* times() const
+		{
+			return u_.data();
+		}
+
+		// pv[k] and, if not null, dur[k] of instrument k on the curve
+		void value(const curve<T,F>& c, F* pv, F* dur = nullptr)
+		{
+			discount(u_.size(), u_.data(), D_.data(), c.n, c.t, c.f, c._f);
+			gather(pv, dur);
+		}
+
+	protected:
+		// dot products of amounts with discounts at their dates
+		void gather(F* pv, F* dur) const
+		{
+			const T* u = u_.data();
+			const size_t* j = j_.data();
+			const F* c = c_.data();
+			const F* D = D_.data();
+
+			for (size_t k = 0; k < size(); ++k) {
+				F p{0}, d{0};
+				for (size_t l = off_[k]; l < off_[k + 1]; ++l) {
+					const T& ul = u[j[l]];
+					const F& Dl = D[j[l]];
+					p += c[l]*Dl;
+					d -= ul*c[l]*Dl;
+				}
+				pv[k] = p;
+				if (dur)
+					dur[k] = d;
+			}
+		}
+	};
+
+	template<class T = double, class F = double>
+	class pricing_plan : public portfolio_pricer<T,F> {
+	protected:
+		std::vector<T> t_;      // curve times the plan was built for
+		std::vector<T> h_;      // segment lengths t[i] - t[i-1]
+		std::vector<size_t> i_; // segment of each date, n past the curve
+		std::vector<T> du_;     // date less start of its segment
+		std::vector<F> I_;      // I_[i] = int_0^t[i-1] f(t) dt
+		size_t rebuilds_;
+
+		bool same(size_t n, const T* t) const
+		{
+			return n == t_.size() && std::equal(t, t + n, t_.begin());
+		}
+		// prefix integrals of the forwards at the curve times
+		void integrals(size_t n, const F* f)
+		{
+			I_[0] = 0;
+			for (size_t i = 0; i < n; ++i)
+				I_[i + 1] = I_[i] + f[i]*h_[i];
+		}
+		// discount at date j after calling integrals
+		F discount(size_t j, size_t n, const F* f, const F& _f) const
+		{
+			size_t i = i_[j];
+
+			return portfolio_pricer<T,F>::u_[j] < 0 ? std::numeric_limits<F>::quiet_NaN()
+				: exp(-(I_[i] + (i == n ? _f : f[i])*du_[j]));
+		}
+		void build(size_t n, const T* t)
+		{
+			const auto& u = portfolio_pricer<T,F>::u_;
+
+			t_.assign(t, t + n);
+			h_.resize(n);
+			for (size_t i = 0; i < n; ++i)
+				h_[i] = t[i] - (i == 0 ? 0 : t[i - 1]);
+
+			i_.resize(u.size());
+			du_.resize(u.size());
+			size_t i = 0;
+			for (size_t j = 0; j < u.size(); ++j) {
+				while (i < n && t[i] < u[j])
+					++i;
+				i_[j] = i;
+				du_[j] = u[j] - (i == 0 ? 0 : t[i - 1]);
+			}
+			I_.resize(n + 1);
+
+			++rebuilds_;
+		}
+	public:
+		pricing_plan(const curve<T,F>& c, const portfolio<T,F>& p)
+			: portfolio_pricer<T,F>(p), rebuilds_(0)
+		{
+			build(c.n, c.t);
+		}
+		pricing_plan(const curve<T,F>& c, size_t n, const instrument_base<T,F>* const* i)
+			: portfolio_pricer<T,F>(n, i), rebuilds_(0)
+		{
+			build(c.n, c.t);
+		}
+
+		// number of times segments were computed
+		size_t rebuilds() const
+		{
+			return rebuilds_;
+		}
+
+		// pv[k] and, if not null, dur[k] of instrument k on the curve
+		void value(const curve<T,F>& c, F* pv, F* dur = nullptr)
+		{
+			const auto& u = portfolio_pricer<T,F>::u_;
+			auto& D = portfolio_pricer<T,F>::D_;
+
+			if (!same(c.n, c.t))
+				build(c.n, c.t);
+
+			integrals(c.n, c.f);
+			for (size_t j = 0; j < u.size(); ++j)
+				D[j] = discount(j, c.n, c.f, c._f);
+
+			portfolio_pricer<T,F>::gather(pv, dur);
+		}
+	};
+
+} // pwflat
+} // fms
+
+#ifdef _DEBUG
+#include <cassert>
+#include "fms_forward.h"
+
+inline void test_fms_portfolio_pricer()
+{
+	using namespace fms;
+
+	pwflat::vector_curve<> f(std::vector<double>{1, 2, 3, 5, 7, 10}, std::vector<double>{.01, .015, .02, .025, .03, .035}, .04);
+
+	portfolio<> p;
+	std::vector<double> t, c;
+	for (int k = 1; k <= 40; ++k) {
+		t.push_back(0.25*k);
+		c.push_back(0.02 + 0.001*(k % 5));
+	}
+	p.push_back(t.size(), t.data(), instrument::SEMIANNUAL, c.data());
+	instrument::fra<> g(0.5, 0.75, 0.02);
+	p.push_back(g);
+
+	std::vector<const instrument_base<>*> i;
+	std::vector<instrument_view<>> v;
+	for (size_t k = 0; k < p.size(); ++k)
+		v.push_back(p[k]);
+	for (const auto& vk : v)
+		i.push_back(&vk);
+
+	pwflat::portfolio_pricer<> q(p), r(i.size(), i.data());
+	assert (q.size() == p.size() && r.size() == p.size());
+	assert (q.dates() == r.dates());
+	assert (q.dates() == 40); // quarterly grid to 10 years, fra dates already on it
+	assert (std::is_sorted(q.times(), q.times() + q.dates()));
+
+	std::vector<double> pv(p.size()), dur(p.size()), pv_(p.size());
+	q.value(f, pv.data(), dur.data());
+	r.value(f, pv_.data());
+	for (size_t k = 0; k < p.size(); ++k) {
+		assert (pv[k] == pwflat::present_value(p[k], f));
+		assert (dur[k] == pwflat::duration(p[k], f));
+		assert (pv_[k] == pv[k]);
+	}
+
+	pwflat::pricing_plan<> plan(f, p);
+	assert (plan.rebuilds() == 1);
+	plan.value(f, pv_.data(), dur.data());
+	for (size_t k = 0; k < p.size(); ++k) {
+		assert (pv_[k] == pv[k]);
+		assert (dur[k] == pwflat::duration(p[k], f));
+	}
+
+	// new forwards on the same times
+	pwflat::vector_curve<> f1(std::vector<double>{1, 2, 3, 5, 7, 10}, std::vector<double>{.02, .015, .025, .02, .03, .03}, .035);
+	q.value(f1, pv.data());
+	plan.value(f1, pv_.data());
+	assert (plan.rebuilds() == 1);
+	for (size_t k = 0; k < p.size(); ++k)
+		assert (pv_[k] == pv[k]);
+
+	// new times
+	pwflat::vector_curve<> f2(std::vector<double>{0.5, 2, 4}, std::vector<double>{.01, .02, .03}, .04);
+	q.value(f2, pv.data());
+	plan.value(f2, pv_.data());
+	assert (plan.rebuilds() == 2);
+	for (size_t k = 0; k < p.size(); ++k)
+		assert (pv_[k] == pv[k]);
+
+	pwflat::pricing_plan<> plan0(pwflat::vector_curve<>{}, i.size(), i.data());
+	plan0.value(f2, pv_.data());
+	assert (plan0.rebuilds() == 2);
+	for (size_t k = 0; k < p.size(); ++k)
+		assert (pv_[k] == pv[k]);
+}
+
+#endif // _DEBUG
@@ -16,6 +16,7 @@
 #include <algorithm> // adjacent_find
 #include <limits>    // quiet_Nan()
 #include <numeric>   // upper/lower_bound
+#include <vector>
 
 namespace fms {
 namespace pwflat {
@@ -24,7 +25,7 @@ namespace pwflat {
 	template<class I>
 	inline bool monotonic(I b, I e)
 	{
-		using T = std::iterator_traits<I>::value_type;
+		using T = typename std::iterator_traits<I>::value_type;
 
 		return e == std::adjacent_find(b, e, [](const T& t0, const T&t1) { return t0 >= t1; });
 	}
@@ -34,6 +35,13 @@ namespace pwflat {
 		return monotonic(t, t + n);
 	}
 
+	// index of segment containing u: smallest i with u <= t[i], or n if u > t[n-1]
+	template<class T>
+	inline size_t segment(const T& u, size_t n, const T* t)
+	{
+		return std::lower_bound(t, t + n, u) - t;
+	}
+
 	// piecewise flat curve
 	// return f[i] if t[i-1] < u <= t[i]
 	// assumes t[i] monotonically increasing
@@ -47,10 +55,9 @@ namespace pwflat {
 		if (u < 0)
 			return std::numeric_limits<F>::quiet_NaN();
 
-		auto ti = std::lower_bound(t, t + n, u);
-		
+		auto i = segment(u, n, t);
 
-		return ti == t + n ? _f : f[ti - t];
+		return i == n ? _f : f[i];
 	}
 
 	// int_0^u f(t) dt
@@ -68,11 +75,41 @@ namespace pwflat {
 			I += f[i] * (t[i] - t_);
 			t_ = t[i];
 		}
-		I += (n == 0 || u > t[n-1] ? _f : f[i]) *(u - t_);
+		if (u != t_) // u == t[n-1] ends with i == n
+			I += (i == n ? _f : f[i]) *(u - t_);
 
 		return I;
 	}
 
+	// cumulative integrals I[i] = int_0^t[i] f(t) dt
+	// accumulated in the same order as integral so the results agree exactly
+	template<class T, class F>
+	inline void integrals(size_t n, const T* t, const F* f, F* I)
+	{
+		F I_{0};
+		T t_{0};
+
+		for (size_t i = 0; i < n; ++i) {
+			I_ += f[i] * (t[i] - t_);
+			I[i] = I_;
+			t_ = t[i];
+		}
+	}
+
+	// int_0^u f(t) dt using cumulative integrals I[i] = int_0^t[i] f(t) dt
+	template<class T, class F>
+	inline F integral(const T& u, size_t n, const T* t, const F* f, const F* I, const F& _f = std::numeric_limits<F>::quiet_NaN())
+	{
+		if (u < 0)
+			return std::numeric_limits<F>::quiet_NaN();
+
+		auto i = segment(u, n, t);
+		F I_ = i == 0 ? F(0) : I[i - 1];
+		T t_ = i == 0 ? T(0) : t[i - 1];
+
+		return I_ + (i == n ? _f : f[i])*(u - t_);
+	}
+
 	// discount D(u) = exp(-int_0^u f(t) dt)
 	template<class T, class F>
 	inline F discount(const T& u, size_t n, const T* t, const F* f, const F& _f = std::numeric_limits<F>::quiet_NaN())
@@ -87,26 +124,150 @@ namespace pwflat {
 		return u <= t[0] ? f[0] : integral(u, n, t, f, _f)/u;
 	}
 
-	// value of instrument having cash flow c[i] at time u[i]
+	// int_0^u f(t) dt for nondecreasing u in one pass over the curve
+	// gives the same values as integral
 	template<class T, class F>
-	inline F present_value(size_t m, const T* u, const F* c, size_t n, const T* t, const F* f, const F& _f = std::numeric_limits<F>::quiet_NaN())
+	class sweep {
+		size_t n;
+		const T* t;
+		const F* f;
+		F _f;
+		size_t i; // current segment
+		T t_;     // start of current segment
+		F I_;     // int_0^t_ f(t) dt
+	public:
+		sweep(size_t n, const T* t, const F* f, const F& _f = std::numeric_limits<F>::quiet_NaN())
+			: n(n), t(t), f(f), _f(_f), i(0), t_(0), I_(0)
+		{ }
+
+		// u must not be less than the previous argument
+		F integral(const T& u)
+		{
+			if (u < 0)
+				return std::numeric_limits<F>::quiet_NaN();
+
+			while (i < n && t[i] < u) {
+				I_ += f[i] * (t[i] - t_);
+				t_ = t[i];
+				++i;
+			}
+
+			return I_ + (i == n ? _f : f[i])*(u - t_);
+		}
+		F discount(const T& u)
+		{
+			return exp(-integral(u));
+		}
+	};
+
+	// call g(m, u, v) with u sorted and scatter the result back to v
+	template<class T, class F, class G>
+	inline void permute(size_t m, const T* u, F* v, const G& g)
+	{
+		std::vector<size_t> p(m);
+		std::iota(p.begin(), p.end(), 0);
+		std::stable_sort(p.begin(), p.end(), [u](size_t i, size_t j) { return u[i] < u[j]; });
+
+		std::vector<T> u_(m);
+		std::vector<F> v_(m);
+		for (size_t j = 0; j < m; ++j)
+			u_[j] = u[p[j]];
+		g(m, u_.data(), v_.data());
+		for (size_t j = 0; j < m; ++j)
+			v[p[j]] = v_[j];
+	}
+
+	// I[j] = int_0^u[j] f(t) dt in O(m + n) if u is sorted
+	template<class T, class F>
+	inline void integral(size_t m, const T* u, F* I, size_t n, const T* t, const F* f, const F& _f = std::numeric_limits<F>::quiet_NaN())
+	{
+		if (!std::is_sorted(u, u + m)) {
+			permute(m, u, I, [n,t,f,_f](size_t m_, const T* u_, F* I_) { integral(m_, u_, I_, n, t, f, _f); });
+
+			return;
+		}
+
+		sweep<T,F> s(n, t, f, _f);
+		for (size_t j = 0; j < m; ++j)
+			I[j] = s.integral(u[j]);
+	}
+
+	// D[j] = exp(-int_0^u[j] f(t) dt)
+	template<class T, class F>
+	inline void discount(size_t m, const T* u, F* D, size_t n, const T* t, const F* f, const F& _f = std::numeric_limits<F>::quiet_NaN())
+	{
+		integral(m, u, D, n, t, f, _f);
+		std::transform(D, D + m, D, [](const F& I) { return exp(-I); });
+	}
+
+	// r[j] = (int_0^u[j] f(t) dt)/u[j]
+	template<class T, class F>
+	inline void spot(size_t m, const T* u, F* r, size_t n, const T* t, const F* f, const F& _f = std::numeric_limits<F>::quiet_NaN())
+	{
+		integral(m, u, r, n, t, f, _f);
+		for (size_t j = 0; j < m; ++j)
+			r[j] = n > 0 && u[j] <= t[0] ? f[0] : r[j]/u[j];
+	}
+
+	// times u[0], ..., u[m-1] in contiguous memory, copied to v unless u is a pointer
+	template<class T>
+	inline const T* contiguous(const T* u, size_t, std::vector<T>&)
+	{
+		return u;
+	}
+	template<class T>
+	inline const T* contiguous(T* u, size_t, std::vector<T>&)
+	{
+		return u;
+	}
+	template<class T, class U>
+	inline const T* contiguous(U u, size_t m, std::vector<T>& v)
+	{
+		v.assign(u, u + m);
+
+		return v.data();
+	}
+
+	// value of instrument having cash flow c[i] at time u[i]
+	// u and c are pointers or random access iterators such as the lazy schedules in fms_schedule.h
+	template<class T, class F, class U, class C>
+	inline F present_value(size_t m, U u, C c, size_t n, const T* t, const F* f, const F& _f = std::numeric_limits<F>::quiet_NaN())
 	{
 		F p{0};
 
-		for (size_t i = 0; i < m; ++i)
-			p += c[i]*pwflat::discount(u[i], n, t, f, _f);
+		if (std::is_sorted(u, u + m)) {
+			sweep<T,F> s(n, t, f, _f);
+			for (size_t i = 0; i < m; ++i)
+				p += c[i]*s.discount(u[i]);
+		}
+		else {
+			std::vector<T> u_;
+			std::vector<F> D(m);
+			discount(m, contiguous(u, m, u_), D.data(), n, t, f, _f);
+			for (size_t i = 0; i < m; ++i)
+				p += c[i]*D[i];
+		}
 
 		return p;
 	}
 
 	// derivative of present value wrt parallel shift of forward curve
-	template<class T, class F>
-	inline F duration(size_t m, const T* u, const F* c, size_t n, const T* t, const F* f, const F& _f = std::numeric_limits<F>::quiet_NaN())
+	template<class T, class F, class U, class C>
+	inline F duration(size_t m, U u, C c, size_t n, const T* t, const F* f, const F& _f = std::numeric_limits<F>::quiet_NaN())
 	{
 		F d{0};
 
-		for (size_t i = 0; i < m; ++i) {
-			d -= u[i]*c[i]*pwflat::discount(u[i], n, t, f, _f);
+		if (std::is_sorted(u, u + m)) {
+			sweep<T,F> s(n, t, f, _f);
+			for (size_t i = 0; i < m; ++i)
+				d -= u[i]*c[i]*s.discount(u[i]);
+		}
+		else {
+			std::vector<T> u_;
+			std::vector<F> D(m);
+			discount(m, contiguous(u, m, u_), D.data(), n, t, f, _f);
+			for (size_t i = 0; i < m; ++i)
+				d -= u[i]*c[i]*D[i];
 		}
 
 		return d;
@@ -122,12 +283,109 @@ namespace pwflat {
 
 		size_t i0 = (n == 0) ? 0 : std::lower_bound(u, u + m, t[n-1]) - u;
 		double t0 = (n == 0) ? 0 : t[n -  1];
+		sweep<T,F> s(n, t, f, _f);
 		for (size_t i = i0; i < m; ++i) {
-			d -= (u[i] - t0)*c[i]*pwflat::discount(u[i], n, t, f, _f);
+			d -= (u[i] - t0)*c[i]*s.discount(u[i]);
 		}
 
 		return d;
 	}
+
+	// present value and derivatives wrt the forward curve
+	template<class F>
+	struct valuation {
+		F pv;                    // present value
+		F duration;              // derivative wrt parallel shift of forward curve
+		F duration_extrapolated; // derivative wrt parallel shift of forward curve after last curve time
+		F convexity;             // second derivative wrt parallel shift of forward curve
+	};
+
+	// present_value, duration, duration_extrapolated, and convexity sharing one discount per cash flow
+	template<class T, class F, class U, class C>
+	inline valuation<F> evaluate(size_t m, U u, C c, size_t n, const T* t, const F* f, const F& _f = std::numeric_limits<F>::quiet_NaN())
+	{
+		valuation<F> v{0, 0, 0, 0};
+		T t0 = (n == 0) ? 0 : t[n - 1];
+
+		// same operations as present_value, duration, and duration_extrapolated
+		auto add = [&v,t0,n](const T& u_, const F& c_, const F& D) {
+			v.pv += c_*D;
+			v.duration -= u_*c_*D;
+			v.convexity += u_*u_*c_*D;
+			if (n == 0 || u_ >= t0)
+				v.duration_extrapolated -= (u_ - t0)*c_*D;
+		};
+
+		if (std::is_sorted(u, u + m)) {
+			sweep<T,F> s(n, t, f, _f);
+			for (size_t i = 0; i < m; ++i)
+				add(u[i], c[i], s.discount(u[i]));
+		}
+		else {
+			std::vector<T> u_;
+			std::vector<F> D(m);
+			discount(m, contiguous(u, m, u_), D.data(), n, t, f, _f);
+			for (size_t i = 0; i < m; ++i)
+				add(u[i], c[i], D[i]);
+		}
+
+		return v;
+	}
+
+	// derivatives of present value wrt each forward
+	// sets df[i] = d(pv)/df[i] for 0 <= i < n and returns d(pv)/d_f in O(m + n)
+	// d(pv)/df[i] = -sum_j c[j] D(u[j]) (min(u[j], t[i]) - t[i-1])^+ is accumulated from the last segment back
+	template<class T, class F>
+	inline F sensitivity(size_t m, const T* u, const F* c, size_t n, const T* t, const F* f, const F& _f, F* df)
+	{
+		if (!std::is_sorted(u, u + m)) {
+			std::vector<size_t> p(m);
+			std::iota(p.begin(), p.end(), 0);
+			std::stable_sort(p.begin(), p.end(), [u](size_t i, size_t j) { return u[i] < u[j]; });
+
+			std::vector<T> u_(m);
+			std::vector<F> c_(m);
+			for (size_t j = 0; j < m; ++j) {
+				u_[j] = u[p[j]];
+				c_[j] = c[p[j]];
+			}
+
+			return sensitivity(m, u_.data(), c_.data(), n, t, f, _f, df);
+		}
+
+		// c[j] D(u[j])
+		std::vector<F> cD(m);
+		sweep<T,F> s(n, t, f, _f);
+		for (size_t j = 0; j < m; ++j)
+			cD[j] = c[j]*s.discount(u[j]);
+
+		F S{0}; // sum of c[j] D(u[j]) past the end of the current segment
+		size_t j = m;
+
+		// extrapolation
+		F d_f{0};
+		T t_ = n > 0 ? t[n - 1] : 0;
+		while (j > 0 && u[j - 1] > t_) {
+			--j;
+			d_f -= cD[j]*(u[j] - t_);
+			S += cD[j];
+		}
+
+		for (size_t i = n; i-- > 0; ) {
+			t_ = i > 0 ? t[i - 1] : 0;
+
+			F A{0}, B{0}; // cash flows in (t[i-1], t[i]]
+			while (j > 0 && u[j - 1] > t_) {
+				--j;
+				A += cD[j]*(u[j] - t_);
+				B += cD[j];
+			}
+			df[i] = -(A + S*(t[i] - t_));
+			S += B;
+		}
+
+		return d_f;
+	}
 } // pwflat
 } // fms
 
@@ -142,6 +400,14 @@ inline void test_fms_pwflat()
 	std::vector<double> t{1,2,3}, f{.1,.2,.3};
 	std::vector<double> t_2{ 1 }, f_2{ .1 };
 	
+	{ // last curve time does not read past f
+		double g[] = {.1, .2, .3, std::numeric_limits<double>::quiet_NaN()};
+		assert (integral(3., 3, t.data(), g) == integral(3., 3, t.data(), g, .4));
+		assert (fabs(integral(3., 3, t.data(), g) - .6) < 1e-15);
+		assert (std::isnan(integral(3.5, 3, t.data(), g)));
+		assert (std::isnan(integral(std::numeric_limits<double>::quiet_NaN(), 3, t.data(), g)));
+		assert (integral(0., 3, t.data(), g) == 0);
+	}
 	{ // monotonic
 		assert (monotonic(std::begin(t), std::end(t)));
 		assert (monotonic(std::begin(f), std::end(f)));
@@ -154,13 +420,13 @@ inline void test_fms_pwflat()
 	{ // forward
 		//!!! add tests
 		//0, 0, null, null, null
-		assert (isnan(value<int,double>(0, 0, nullptr, nullptr)));
+		assert (std::isnan(value<int,double>(0, 0, nullptr, nullptr)));
 		//1, 0, null, null, null
-		assert(isnan(value<int, double>(1, 0, nullptr, nullptr)));
+		assert(std::isnan(value<int, double>(1, 0, nullptr, nullptr)));
 		//-1, 0, null, null, null
-		assert(isnan(value<int, double>(-1, 0, nullptr, nullptr)));
+		assert(std::isnan(value<int, double>(-1, 0, nullptr, nullptr)));
 		//-1, 0, null, null, 0.2
-		assert(isnan(value<int, double>(-1, 0, nullptr, nullptr, 0.2)));
+		assert(std::isnan(value<int, double>(-1, 0, nullptr, nullptr, 0.2)));
 		
 		int u;
 		u = 1;
@@ -174,7 +440,7 @@ inline void test_fms_pwflat()
 
 		for (int i = 0; i < 5; i++) {
 			if (i == 0 || i == 4) {
-				assert(isnan(value<double, double>(u_[i], t_2.size(), t_2.data(), f_2.data())));
+				assert(std::isnan(value<double, double>(u_[i], t_2.size(), t_2.data(), f_2.data())));
 			}
 			else {
 				x_ = fms::pwflat::value<double, double>(u_[i], t_2.size(), t_2.data(), f_2.data());
@@ -184,7 +450,7 @@ inline void test_fms_pwflat()
 
 		for (int i = 0; i < 5; i++) {
 			if (i == 0)
-				assert(isnan(value<double, double>(u_[i], t_2.size(), t_2.data(), f_2.data(), 0.2)));
+				assert(std::isnan(value<double, double>(u_[i], t_2.size(), t_2.data(), f_2.data(), 0.2)));
 			else {
 				x_ = fms::pwflat::value<double, double>(u_[i], t_2.size(), t_2.data(), f_2.data(), 0.2);
 				assert(x_ == a_[i]);
@@ -200,9 +466,9 @@ inline void test_fms_pwflat()
 	{ // integral
 		double u;
 		u = -1;
-		assert (isnan(integral(u, t.size(), t.data(), f.data())));
+		assert (std::isnan(integral(u, t.size(), t.data(), f.data())));
 		u = 4;
-		assert (isnan(integral(u, t.size(), t.data(), f.data())));
+		assert (std::isnan(integral(u, t.size(), t.data(), f.data())));
 		u = 0;
 		assert (0 == integral(u, t.size(), t.data(), f.data()));
 		u = 0.5;
@@ -223,14 +489,14 @@ inline void test_fms_pwflat()
 		double f_[] = {0, 0, .05, .1, .2, .3, .45, .6, .7};
 		for (int i = 0; i < 9; i++) {
 			if (i == 0 || i == 8)
-				assert(isnan(discount(u_[i], t.size(), t.data(), f.data())));
+				assert(std::isnan(discount(u_[i], t.size(), t.data(), f.data())));
 			else
 				assert(fabs(exp(-f_[i]) - discount(u_[i], t.size(), t.data(), f.data())) < 1e-10);
 		}
 
 		for (int i = 0; i < 9; i++) {
 			if (i == 0)
-				assert(isnan(discount(u_[i], t.size(), t.data(), f.data(), 0.2)));
+				assert(std::isnan(discount(u_[i], t.size(), t.data(), f.data(), 0.2)));
 			else
 				assert(fabs(exp(-f_[i]) - discount(u_[i], t.size(), t.data(), f.data(), 0.2)) < 1e-10);
 		}
@@ -241,7 +507,7 @@ inline void test_fms_pwflat()
 		double f_[] = { .1, .1, .1, .1, .2/1.5, .3/2, .45/2.5, .6/3, .7/3.5 };
 		for (int i = 0; i < 9; i++) {
 			if (i == 8)
-				assert(isnan(spot(u_[i], t.size(), t.data(), f.data())));
+				assert(std::isnan(spot(u_[i], t.size(), t.data(), f.data())));
 			else
 				assert(fabs(f_[i] - spot(u_[i], t.size(), t.data(), f.data())) < 1e-10);
 		}
@@ -262,8 +528,8 @@ inline void test_fms_pwflat()
 		};
 		double c_[] = { 0, 1, 2, 3, 4 };
 
-		//assert(isnan(present_value(1, u_, c_, t.size(), t.data(), f.data())));
-		//assert(isnan(present_value(1, u_, c_, t.size(), t.data(), f.data(), 0.2)));
+		//assert(std::isnan(present_value(1, u_, c_, t.size(), t.data(), f.data())));
+		//assert(std::isnan(present_value(1, u_, c_, t.size(), t.data(), f.data(), 0.2)));
 
 		double sum = 0;
 		for (int i = 0; i < 5; i++) {
@@ -272,7 +538,7 @@ inline void test_fms_pwflat()
 				double tmp = present_value<double, double>(i + 1, u_, c_, t.size(), t.data(), f.data(), 0.2);
 				assert(tmp == tmp);
 				assert(fabs(sum - present_value(i + 1, u_, c_, t.size(), t.data(), f.data(), 0.2)) < 1e-10);
-				assert(isnan(present_value(i + 1, u_, c_, t.size(), t.data(), f.data())));
+				assert(std::isnan(present_value(i + 1, u_, c_, t.size(), t.data(), f.data())));
 			}
 			else {
 				double tmp = present_value<double, double>(i + 1, u_, c_, t.size(), t.data(), f.data(), 0.2);
@@ -283,6 +549,108 @@ inline void test_fms_pwflat()
 		}
 		
 	}
+	{ // batch evaluation agrees with point evaluation
+		double u_[] = { -.5, 0, .5, 1, 1.5, 2, 2, 2.5, 3, 3.5 };
+		double v_[] = { 3, .5, 2.5, -.5, 1, 3.5, 2, 0, 1.5, 2 }; // unsorted
+		double I[10], D[10], r[10];
+
+		for (double* w : {u_, v_}) {
+			integral(10, w, I, t.size(), t.data(), f.data(), 0.2);
+			discount(10, w, D, t.size(), t.data(), f.data(), 0.2);
+			spot(10, w, r, t.size(), t.data(), f.data(), 0.2);
+			for (int j = 0; j < 10; ++j) {
+				if (w[j] < 0) {
+					assert (std::isnan(I[j]));
+					assert (std::isnan(D[j]));
+				}
+				else {
+					assert (I[j] == integral(w[j], t.size(), t.data(), f.data(), 0.2));
+					assert (D[j] == discount(w[j], t.size(), t.data(), f.data(), 0.2));
+				}
+				assert (r[j] == spot(w[j], t.size(), t.data(), f.data(), 0.2));
+			}
+
+			// no extrapolation
+			integral(10, w, I, t.size(), t.data(), f.data());
+			for (int j = 0; j < 10; ++j)
+				assert (std::isnan(I[j]) == (w[j] < 0 || w[j] > 3));
+		}
+
+		double c_[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+		double p = 0, d = 0;
+		for (int j = 1; j < 10; ++j) {
+			p += c_[j]*discount(u_[j], t.size(), t.data(), f.data(), 0.2);
+			d -= u_[j]*c_[j]*discount(u_[j], t.size(), t.data(), f.data(), 0.2);
+		}
+		assert (p == present_value(9, u_ + 1, c_ + 1, t.size(), t.data(), f.data(), 0.2));
+		assert (d == duration(9, u_ + 1, c_ + 1, t.size(), t.data(), f.data(), 0.2));
+
+		// same cash flows in reverse order
+		double ur[9], cr[9];
+		std::reverse_copy(u_ + 1, u_ + 10, ur);
+		std::reverse_copy(c_ + 1, c_ + 10, cr);
+		assert (fabs(p - present_value(9, ur, cr, t.size(), t.data(), f.data(), 0.2)) < 1e-12);
+		assert (fabs(d - duration(9, ur, cr, t.size(), t.data(), f.data(), 0.2)) < 1e-12);
+	}
+	{ // evaluate agrees with separate functions
+		double u_[] = { .5, 1, 1.5, 2, 2.5, 3, 3.5, 4 };
+		double c_[] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+
+		for (size_t n = 0; n <= t.size(); ++n) {
+			auto v = evaluate(8, u_, c_, n, t.data(), f.data(), 0.2);
+			assert (v.pv == present_value(8, u_, c_, n, t.data(), f.data(), 0.2));
+			assert (v.duration == duration(8, u_, c_, n, t.data(), f.data(), 0.2));
+			assert (v.duration_extrapolated == duration_extrapolated(8, u_, c_, n, t.data(), f.data(), 0.2));
+
+			// convexity numerically
+			double h = 1e-4;
+			std::vector<double> fu(f), fd(f);
+			for (size_t i = 0; i < n; ++i) {
+				fu[i] += h;
+				fd[i] -= h;
+			}
+			double pu = present_value(8, u_, c_, n, t.data(), fu.data(), 0.2 + h);
+			double pd = present_value(8, u_, c_, n, t.data(), fd.data(), 0.2 - h);
+			assert (fabs((pu - 2*v.pv + pd)/(h*h) - v.convexity) < 1e-4*v.convexity);
+		}
+	}
+	{ // sensitivity
+		double u_[] = { .5, 1, 1.25, 2, 2.5, 3, 3.5, 4 };
+		double c_[] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+		double ur[8], cr[8];
+		std::reverse_copy(u_, u_ + 8, ur);
+		std::reverse_copy(c_, c_ + 8, cr);
+
+		for (size_t n = 0; n <= t.size(); ++n) {
+			std::vector<double> df(n), dr(n);
+			double d_f = sensitivity(8, u_, c_, n, t.data(), f.data(), 0.2, df.data());
+			assert (d_f == sensitivity(8, ur, cr, n, t.data(), f.data(), 0.2, dr.data()));
+			assert (df == dr);
+
+			// bucketed derivatives add up to duration
+			double d = d_f;
+			for (size_t i = 0; i < n; ++i)
+				d += df[i];
+			assert (fabs(d - duration(8, u_, c_, n, t.data(), f.data(), 0.2)) < 1e-12);
+			assert (fabs(d_f - duration_extrapolated(8, u_, c_, n, t.data(), f.data(), 0.2)) < 1e-12);
+
+			// numerical derivatives
+			double h = 1e-6;
+			for (size_t i = 0; i < n; ++i) {
+				std::vector<double> fu(f), fd(f);
+				fu[i] += h;
+				fd[i] -= h;
+				double pu = present_value(8, u_, c_, n, t.data(), fu.data(), 0.2);
+				double pd = present_value(8, u_, c_, n, t.data(), fd.data(), 0.2);
+				assert (fabs((pu - pd)/(2*h) - df[i]) < 1e-6);
+			}
+		}
+
+		// no extrapolation
+		std::vector<double> df(3);
+		assert (std::isnan(sensitivity(8, u_, c_, 3, t.data(), f.data(), std::numeric_limits<double>::quiet_NaN(), df.data())));
+		assert (!std::isnan(sensitivity(6, u_, c_, 3, t.data(), f.data(), std::numeric_limits<double>::quiet_NaN(), df.data())));
+	}
 }
 
 #endif // _DEBUG
\ No newline at end of file
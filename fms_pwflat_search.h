@@ -0,0 +1,204 @@
+// fms_pwflat_search.h - segment search for large curves
+/*
+	Times are copied in breadth first (Eytzinger) order: b[1] is the median, the children of b[k]
+	are b[2k] and b[2k+1]. Searching descends with k = 2k + (b[k] < u) which has no unpredictable branches,
+	and the cache line holding the descendants several levels down is prefetched while comparing.
+	Clearing the trailing ones of k recovers the node where the search last went left, i.e. lower_bound.
+*/
+#pragma once
+#include <algorithm>
+#include <vector>
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+#include <xmmintrin.h> // _mm_prefetch
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace fms {
+namespace pwflat {
+
+	inline void prefetch(const void* p)
+	{
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+		_mm_prefetch(static_cast<const char*>(p), _MM_HINT_T0);
+#elif defined(__GNUC__)
+		__builtin_prefetch(p);
+#else
+		(void)p;
+#endif
+	}
+
+	// number of trailing one bits
+	inline unsigned trailing_ones(size_t k)
+	{
+		k = ~k;
+#ifdef _MSC_VER
+		unsigned long i;
+#ifdef _WIN64
+		_BitScanForward64(&i, k);
+#else
+		_BitScanForward(&i, static_cast<unsigned long>(k));
+#endif
+		return i;
+#else
+		return __builtin_ctzll(k);
+#endif
+	}
+
+	// lower_bound over a breadth first copy of the times
+	template<class T = double>
+	class eytzinger {
+		size_t n;
+		std::vector<T> b;      // b[k], 0 < k <= n, in breadth first order
+		std::vector<size_t> i; // i[k] is the index of b[k] in the sorted times, i[0] = n
+
+		size_t build(const T* t, size_t j, size_t k)
+		{
+			if (k <= n) {
+				j = build(t, j, 2*k);
+				b[k] = t[j];
+				i[k] = j++;
+				j = build(t, j, 2*k + 1);
+			}
+
+			return j;
+		}
+	public:
+		eytzinger(size_t n = 0, const T* t = nullptr)
+			: n(n), b(n + 1), i(n + 1)
+		{
+			i[0] = n;
+			build(t, 0, 1);
+		}
+
+		size_t size() const
+		{
+			return n;
+		}
+
+		// same as pwflat::segment: smallest i with u <= t[i], or n if u > t[n-1]
+		size_t segment(const T& u) const
+		{
+			static const size_t line = 64/sizeof(T); // elements per cache line
+			const T* b_ = b.data();
+			size_t k = 1;
+
+			while (k <= n) {
+				prefetch(b_ + line*k);
+				k = 2*k + (b_[k] < u);
+			}
+			k >>= trailing_ones(k) + 1;
+
+			return i[k];
+		}
+	};
+
+	// curves with at least this many points use an eytzinger index
+	static const size_t search_threshold = 32;
+
+	// search a curve that grows at the end
+	// the index covers the first n0 times and is rebuilt when the curve doubles
+	template<class T = double>
+	class search_index {
+		size_t n;
+		const T* t;
+		eytzinger<T> e;
+	public:
+		search_index(size_t n = 0, const T* t = nullptr)
+			: n(0), t(nullptr)
+		{
+			reset(n, t);
+		}
+
+		// call when the times move or grow at the end
+		// the first size() times indexed must be unchanged, use rebuild otherwise
+		void reset(size_t n_, const T* t_)
+		{
+			n = n_;
+			t = t_;
+			if (n < search_threshold)
+				e = eytzinger<T>();
+			else if (n >= 2*e.size())
+				e = eytzinger<T>(n, t);
+		}
+		// call when any of the times change
+		void rebuild(size_t n_, const T* t_)
+		{
+			n = n_;
+			t = t_;
+			e = n < search_threshold ? eytzinger<T>() : eytzinger<T>(n, t);
+		}
+
+		size_t segment(const T& u) const
+		{
+			size_t n0 = e.size();
+
+			if (n0 == 0 || u > t[n0 - 1])
+				return n0 + (std::lower_bound(t + n0, t + n, u) - (t + n0));
+
+			return e.segment(u);
+		}
+	};
+
+} // pwflat
+} // fms
+
+#ifdef _DEBUG
+#include <cassert>
+#include <random>
+#include "fms_pwflat.h"
+
+inline void test_fms_pwflat_search()
+{
+	using namespace fms::pwflat;
+
+	for (size_t n : {0, 1, 2, 3, 7, 8, 9, 100, 1000}) {
+		std::vector<double> t(n);
+		for (size_t i = 0; i < n; ++i)
+			t[i] = 0.5*(i + 1);
+		eytzinger<> e(n, t.data());
+		assert (e.size() == n);
+
+		for (size_t j = 0; j <= 2*n + 2; ++j) {
+			double u = 0.25*j - 0.1;
+			assert (e.segment(u) == segment(u, n, t.data()));
+			u = 0.25*j; // on the grid
+			assert (e.segment(u) == segment(u, n, t.data()));
+		}
+		assert (e.segment(std::numeric_limits<double>::quiet_NaN()) == segment(std::numeric_limits<double>::quiet_NaN(), n, t.data()));
+	}
+	{ // growing curve
+		std::default_random_engine dre;
+		std::uniform_real_distribution<> u(-1, 600);
+		std::vector<double> t;
+		t.reserve(500);
+		search_index<> s;
+
+		for (size_t n = 1; n <= 500; ++n) {
+			t.push_back(n);
+			s.reset(t.size(), t.data());
+			for (int j = 0; j < 10; ++j) {
+				double x = u(dre);
+				assert (s.segment(x) == segment(x, t.size(), t.data()));
+			}
+			double x = std::numeric_limits<double>::quiet_NaN();
+			assert (s.segment(x) == segment(x, t.size(), t.data()));
+		}
+	}
+	{ // same number of times with different values
+		std::vector<double> t(100);
+		for (size_t i = 0; i < t.size(); ++i)
+			t[i] = i + 1.;
+		search_index<> s(t.size(), t.data());
+		for (auto& ti : t)
+			ti *= 2;
+		s.rebuild(t.size(), t.data());
+		for (int j = 0; j < 420; ++j) {
+			double x = 0.5*j - 1;
+			assert (s.segment(x) == segment(x, t.size(), t.data()));
+		}
+	}
+}
+
+#endif // _DEBUG
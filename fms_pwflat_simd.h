@@ -0,0 +1,459 @@
+// fms_pwflat_simd.h - vectorized discount, spot, and forward for arrays of times
+/*
+	Each time u is located in segment i, the smallest i with u <= t[i], by walking the curve if
+	the times are sorted and by binary search (or an eytzinger index for large curves) otherwise. Then
+	int_0^u f(t) dt = I0[i] + f0[i]*(u - t0[i]) where t0[i] = t[i-1], I0[i] = int_0^t[i-1] f(t) dt
+	and f0[i] = f[i] for i < n, f0[n] = _f. These are gathered 4 (AVX2) or 8 (AVX-512) lanes at a time.
+
+	The integral is computed with the same operations as pwflat::integral so spot and forward
+	agree exactly with fms_pwflat.h. The vector exp uses range reduction x = k log(2) + r, |r| <= log(2)/2,
+	and a degree 13 polynomial for exp(r). Its relative error is at most 2 ULP for -708 < x < 709,
+	so discount agrees with pwflat::discount to within 2 ULP. It returns 0 for x < -708 and infinity for x > 709.
+*/
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+#include "fms_pwflat.h"
+#include "fms_pwflat_search.h"
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define FMS_SIMD_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define FMS_TARGET_AVX2
+#define FMS_TARGET_AVX512
+#else
+#define FMS_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define FMS_TARGET_AVX512 __attribute__((target("avx512f")))
+#endif
+#if !defined(_MSC_VER) || _MSC_VER >= 1911
+#define FMS_SIMD_AVX512
+#endif
+#endif
+
+namespace fms {
+namespace pwflat {
+namespace simd {
+
+	enum isa {
+		SCALAR = 1,
+		AVX2 = 4,   // lanes
+		AVX512 = 8
+	};
+
+	// best instruction set supported by the cpu and operating system
+	inline isa detect()
+	{
+#ifdef FMS_SIMD_X86
+#ifdef _MSC_VER
+		int r[4];
+		__cpuid(r, 0);
+		if (r[0] < 7)
+			return SCALAR;
+		__cpuid(r, 1);
+		bool fma = (r[2] & (1 << 12)) != 0;
+		bool osxsave = (r[2] & (1 << 27)) != 0;
+		if (!fma || !osxsave)
+			return SCALAR;
+		unsigned long long xcr0 = _xgetbv(0);
+		__cpuidex(r, 7, 0);
+		if ((r[1] & (1 << 16)) && (xcr0 & 0xE6) == 0xE6)
+			return AVX512;
+		if ((r[1] & (1 << 5)) && (xcr0 & 0x6) == 0x6)
+			return AVX2;
+#else
+		__builtin_cpu_init();
+#ifdef FMS_SIMD_AVX512
+		if (__builtin_cpu_supports("avx512f"))
+			return AVX512;
+#endif
+		if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+			return AVX2;
+#endif
+#endif
+		return SCALAR;
+	}
+
+	// detect once
+	inline isa best()
+	{
+		static const isa i = detect();
+
+		return i;
+	}
+
+	// coefficients 1/k! of the polynomial for exp(r)
+	static const double exp_c[] = {
+		1., 1., 1./2, 1./6, 1./24, 1./120, 1./720, 1./5040, 1./40320, 1./362880,
+		1./3628800, 1./39916800, 1./479001600, 1./6227020800.
+	};
+	static const double exp_lo = -708;
+	static const double exp_hi = 709;
+	static const double log2e = 1.4426950408889634074;
+	static const double ln2_hi = 6.93145751953125e-1;           // 21 significant bits so k*ln2_hi is exact
+	static const double ln2_lo = 1.42860682030941723212e-6;     // log(2) - ln2_hi
+
+#ifdef FMS_SIMD_X86
+	// exp for 4 lanes
+	FMS_TARGET_AVX2
+	inline __m256d exp(__m256d x)
+	{
+		const __m256d magic = _mm256_set1_pd(6755399441055744.); // 1.5*2^52
+		__m256d kd = _mm256_add_pd(_mm256_mul_pd(x, _mm256_set1_pd(log2e)), magic);
+		__m256i k = _mm256_sub_epi64(_mm256_castpd_si256(kd), _mm256_castpd_si256(magic));
+		kd = _mm256_sub_pd(kd, magic); // round(x/log(2))
+
+		__m256d r = _mm256_fnmadd_pd(kd, _mm256_set1_pd(ln2_hi), x);
+		r = _mm256_fnmadd_pd(kd, _mm256_set1_pd(ln2_lo), r);
+
+		__m256d p = _mm256_set1_pd(exp_c[13]);
+		for (int j = 12; j >= 0; --j)
+			p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(exp_c[j]));
+
+		// 2^k
+		__m256i e = _mm256_slli_epi64(_mm256_add_epi64(k, _mm256_set1_epi64x(1023)), 52);
+		p = _mm256_mul_pd(p, _mm256_castsi256_pd(e));
+
+		p = _mm256_blendv_pd(p, _mm256_setzero_pd(), _mm256_cmp_pd(x, _mm256_set1_pd(exp_lo), _CMP_LT_OQ));
+		p = _mm256_blendv_pd(p, _mm256_set1_pd(std::numeric_limits<double>::infinity()), _mm256_cmp_pd(x, _mm256_set1_pd(exp_hi), _CMP_GT_OQ));
+
+		return p;
+	}
+
+#ifdef FMS_SIMD_AVX512
+	// exp for 8 lanes
+	FMS_TARGET_AVX512
+	inline __m512d exp(__m512d x)
+	{
+		// the _mask_ forms with all lanes set are the plain ones with a defined source,
+		// which keeps gcc from warning about the undefined source inside its intrinsics
+		__m512d kd = _mm512_mask_roundscale_pd(x, 0xFF, _mm512_mul_pd(x, _mm512_set1_pd(log2e)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+
+		__m512d r = _mm512_fnmadd_pd(kd, _mm512_set1_pd(ln2_hi), x);
+		r = _mm512_fnmadd_pd(kd, _mm512_set1_pd(ln2_lo), r);
+
+		__m512d p = _mm512_set1_pd(exp_c[13]);
+		for (int j = 12; j >= 0; --j)
+			p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(exp_c[j]));
+
+		p = _mm512_mask_scalef_pd(p, 0xFF, p, kd); // p*2^k
+
+		p = _mm512_mask_blend_pd(_mm512_cmp_pd_mask(x, _mm512_set1_pd(exp_lo), _CMP_LT_OQ), p, _mm512_setzero_pd());
+		p = _mm512_mask_blend_pd(_mm512_cmp_pd_mask(x, _mm512_set1_pd(exp_hi), _CMP_GT_OQ), p, _mm512_set1_pd(std::numeric_limits<double>::infinity()));
+
+		return p;
+	}
+#endif
+
+	// exp of arrays, returns number of values computed
+	FMS_TARGET_AVX2
+	inline size_t exp256(size_t m, const double* x, double* y)
+	{
+		size_t j;
+		for (j = 0; j + 4 <= m; j += 4)
+			_mm256_storeu_pd(y + j, exp(_mm256_loadu_pd(x + j)));
+
+		return j;
+	}
+#ifdef FMS_SIMD_AVX512
+	FMS_TARGET_AVX512
+	inline size_t exp512(size_t m, const double* x, double* y)
+	{
+		size_t j;
+		for (j = 0; j + 8 <= m; j += 8)
+			_mm512_storeu_pd(y + j, exp(_mm512_loadu_pd(x + j)));
+
+		return j;
+	}
+#endif
+#endif
+
+	// y[j] = exp(x[j])
+	inline void exp(size_t m, const double* x, double* y, isa i = best())
+	{
+		size_t j = 0;
+
+#ifdef FMS_SIMD_X86
+#ifdef FMS_SIMD_AVX512
+		if (i == AVX512)
+			j = exp512(m, x, y);
+		else
+#endif
+		if (i >= AVX2)
+			j = exp256(m, x, y);
+#else
+		(void)i;
+#endif
+		for (; j < m; ++j)
+			y[j] = std::exp(x[j]);
+	}
+
+	// piecewise flat curve laid out for vector evaluation
+	class evaluator {
+		size_t n;
+		std::vector<double> t;  // t[i]
+		std::vector<double> t0; // t0[i] = t[i-1], t0[0] = 0
+		std::vector<double> I0; // I0[i] = int_0^t0[i] f(t) dt
+		std::vector<double> f0; // f0[i] = f[i], f0[n] = _f
+		eytzinger<double> e;    // used for unsorted times on large curves
+	public:
+		evaluator(size_t n, const double* t, const double* f, double _f = std::numeric_limits<double>::quiet_NaN())
+			: n(n), t(t, t + n), t0(n + 1), I0(n + 1), f0(n + 1), e(n >= search_threshold ? eytzinger<double>(n, t) : eytzinger<double>())
+		{
+			t0[0] = 0;
+			std::copy(t, t + n, t0.begin() + 1);
+			I0[0] = 0;
+			pwflat::integrals(n, t, f, I0.data() + 1);
+			std::copy(f, f + n, f0.begin());
+			f0[n] = _f;
+		}
+
+		// D[j] = exp(-int_0^u[j] f(t) dt)
+		void discount(size_t m, const double* u, double* D, isa i = best()) const
+		{
+			evaluate(m, u, D, nullptr, nullptr, i);
+		}
+		// r[j] = (int_0^u[j] f(t) dt)/u[j]
+		void spot(size_t m, const double* u, double* r, isa i = best()) const
+		{
+			evaluate(m, u, nullptr, r, nullptr, i);
+		}
+		// f[j] = f(u[j])
+		void forward(size_t m, const double* u, double* f, isa i = best()) const
+		{
+			evaluate(m, u, nullptr, nullptr, f, i);
+		}
+		// any of D, r, f may be null
+		void evaluate(size_t m, const double* u, double* D, double* r, double* f, isa i = best()) const
+		{
+			static const size_t block = 256;
+			long long k[block]; // segment of each time
+			bool sorted = std::is_sorted(u, u + m);
+			size_t k_ = 0;
+
+			for (size_t b = 0; b < m; b += block) {
+				size_t m_ = std::min(block, m - b);
+				for (size_t j = 0; j < m_; ++j) {
+					if (sorted && u[b + j] == u[b + j]) {
+						// walk the curve with the times
+						while (k_ < n && t[k_] < u[b + j])
+							++k_;
+						k[j] = static_cast<long long>(k_);
+					}
+					else {
+						k[j] = static_cast<long long>(e.size() ? e.segment(u[b + j]) : pwflat::segment(u[b + j], n, t.data()));
+					}
+				}
+				evaluate(m_, u + b, k, D ? D + b : D, r ? r + b : r, f ? f + b : f, i);
+			}
+		}
+
+	private:
+		void evaluate(size_t m, const double* u, const long long* k, double* D, double* r, double* f, isa i) const
+		{
+			size_t j = 0;
+
+#ifdef FMS_SIMD_X86
+#ifdef FMS_SIMD_AVX512
+			if (i == AVX512)
+				j = evaluate512(m, u, k, D, r, f);
+			else
+#endif
+			if (i >= AVX2)
+				j = evaluate256(m, u, k, D, r, f);
+#else
+			(void)i;
+#endif
+			for (; j < m; ++j) {
+				double I = I0[k[j]] + f0[k[j]]*(u[j] - t0[k[j]]);
+				bool neg = u[j] < 0;
+
+				if (D)
+					D[j] = neg ? std::numeric_limits<double>::quiet_NaN() : std::exp(-I);
+				if (r)
+					r[j] = n > 0 && u[j] <= t[0] ? f0[0] : I/u[j];
+				if (f)
+					f[j] = neg ? std::numeric_limits<double>::quiet_NaN() : f0[k[j]];
+			}
+		}
+
+#ifdef FMS_SIMD_X86
+		// returns number of times evaluated
+		FMS_TARGET_AVX2
+		size_t evaluate256(size_t m, const double* u, const long long* k, double* D, double* r, double* f) const
+		{
+			const __m256d nan = _mm256_set1_pd(std::numeric_limits<double>::quiet_NaN());
+			const __m256d zero = _mm256_setzero_pd();
+			const __m256d t_0 = _mm256_set1_pd(n > 0 ? t[0] : -std::numeric_limits<double>::infinity());
+			const __m256d f_0 = _mm256_set1_pd(f0[0]);
+
+			size_t j;
+			for (j = 0; j + 4 <= m; j += 4) {
+				__m256i k_ = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(k + j));
+				__m256d u_ = _mm256_loadu_pd(u + j);
+				__m256d t0_ = _mm256_i64gather_pd(t0.data(), k_, 8);
+				__m256d I0_ = _mm256_i64gather_pd(I0.data(), k_, 8);
+				__m256d f0_ = _mm256_i64gather_pd(f0.data(), k_, 8);
+				// same operations as pwflat::integral
+				__m256d I = _mm256_add_pd(I0_, _mm256_mul_pd(f0_, _mm256_sub_pd(u_, t0_)));
+				__m256d neg = _mm256_cmp_pd(u_, zero, _CMP_LT_OQ);
+
+				if (D)
+					_mm256_storeu_pd(D + j, _mm256_blendv_pd(exp(_mm256_sub_pd(zero, I)), nan, neg));
+				if (r)
+					_mm256_storeu_pd(r + j, _mm256_blendv_pd(_mm256_div_pd(I, u_), f_0, _mm256_cmp_pd(u_, t_0, _CMP_LE_OQ)));
+				if (f)
+					_mm256_storeu_pd(f + j, _mm256_blendv_pd(f0_, nan, neg));
+			}
+
+			return j;
+		}
+#ifdef FMS_SIMD_AVX512
+		FMS_TARGET_AVX512
+		size_t evaluate512(size_t m, const double* u, const long long* k, double* D, double* r, double* f) const
+		{
+			const __m512d nan = _mm512_set1_pd(std::numeric_limits<double>::quiet_NaN());
+			const __m512d zero = _mm512_setzero_pd();
+			const __m512d t_0 = _mm512_set1_pd(n > 0 ? t[0] : -std::numeric_limits<double>::infinity());
+			const __m512d f_0 = _mm512_set1_pd(f0[0]);
+
+			size_t j;
+			for (j = 0; j + 8 <= m; j += 8) {
+				__m512i k_ = _mm512_loadu_si512(k + j);
+				__m512d u_ = _mm512_loadu_pd(u + j);
+				__m512d t0_ = _mm512_mask_i64gather_pd(zero, 0xFF, k_, t0.data(), 8);
+				__m512d I0_ = _mm512_mask_i64gather_pd(zero, 0xFF, k_, I0.data(), 8);
+				__m512d f0_ = _mm512_mask_i64gather_pd(zero, 0xFF, k_, f0.data(), 8);
+				__m512d I = _mm512_add_pd(I0_, _mm512_mul_pd(f0_, _mm512_sub_pd(u_, t0_)));
+				__mmask8 neg = _mm512_cmp_pd_mask(u_, zero, _CMP_LT_OQ);
+
+				if (D)
+					_mm512_storeu_pd(D + j, _mm512_mask_blend_pd(neg, exp(_mm512_sub_pd(zero, I)), nan));
+				if (r)
+					_mm512_storeu_pd(r + j, _mm512_mask_blend_pd(_mm512_cmp_pd_mask(u_, t_0, _CMP_LE_OQ), _mm512_div_pd(I, u_), f_0));
+				if (f)
+					_mm512_storeu_pd(f + j, _mm512_mask_blend_pd(neg, f0_, nan));
+			}
+
+			return j;
+		}
+#endif
+#endif
+	};
+
+	// number of doubles from x to y, NaN if either is NaN
+	inline double ulp(double x, double y)
+	{
+		if (x != x || y != y)
+			return std::numeric_limits<double>::quiet_NaN();
+		if (x == y)
+			return 0;
+
+		// bit patterns ordered like the doubles
+		const uint64_t sign = 0x8000000000000000ULL;
+		uint64_t a, b;
+		memcpy(&a, &x, sizeof(a));
+		memcpy(&b, &y, sizeof(b));
+		a = a & sign ? sign - (a & ~sign) : sign + a;
+		b = b & sign ? sign - (b & ~sign) : sign + b;
+
+		return static_cast<double>(a > b ? a - b : b - a);
+	}
+
+} // simd
+} // pwflat
+} // fms
+
+#ifdef _DEBUG
+#include <cassert>
+#include <random>
+
+inline void test_fms_pwflat_simd()
+{
+	using namespace fms::pwflat;
+
+	{ // ulp counts doubles, not relative error
+		double d = std::numeric_limits<double>::denorm_min();
+		assert (simd::ulp(1, nextafter(1., 2.)) == 1);
+		assert (simd::ulp(1, nextafter(1., 0.)) == 1);
+		assert (simd::ulp(nextafter(1., 0.), nextafter(1., 2.)) == 2);
+		assert (simd::ulp(-0., 0.) == 0);
+		assert (simd::ulp(-d, d) == 2);
+		assert (std::isnan(simd::ulp(1, std::numeric_limits<double>::quiet_NaN())));
+	}
+	{ // vector exp
+		std::default_random_engine dre;
+		std::uniform_real_distribution<> x(-700, 700);
+		std::vector<double> e(1003), y(1003);
+
+		for (size_t j = 0; j < e.size(); ++j)
+			e[j] = j % 2 ? x(dre) : x(dre)/700;
+		e[0] = -800;
+		e[1] = 800;
+		e[2] = std::numeric_limits<double>::quiet_NaN();
+
+		for (auto i : {simd::SCALAR, simd::AVX2, simd::AVX512}) {
+			if (i > simd::best())
+				continue;
+
+			simd::exp(e.size(), e.data(), y.data(), i);
+			assert (y[0] == 0);
+			assert (y[1] == std::numeric_limits<double>::infinity());
+			assert (std::isnan(y[2]));
+			for (size_t j = 3; j < e.size(); ++j)
+				assert (simd::ulp(y[j], exp(e[j])) <= 2);
+		}
+	}
+	{ // agree with scalar functions
+		std::vector<double> t{.25, .5, 1, 2, 3, 5, 7, 10}, f{.01, .012, .015, .02, .022, .025, .027, .03};
+		std::vector<double> u{-1, 0, .1, .25, .3, .5, 1, 1.5, 2, 2.5, 3, 4, 5, 6, 7, 8, 10, 12, 15, 20, 30};
+
+		std::vector<double> v(u.rbegin(), u.rend()); // unsorted
+
+		for (double _f : {0.03, std::numeric_limits<double>::quiet_NaN(), 0.03, std::numeric_limits<double>::quiet_NaN()}) {
+			u.swap(v);
+			simd::evaluator e(t.size(), t.data(), f.data(), _f);
+			size_t m = u.size();
+
+			for (auto i : {simd::SCALAR, simd::AVX2, simd::AVX512}) {
+				if (i > simd::best())
+					continue;
+
+				std::vector<double> D(m), r(m), g(m);
+				e.evaluate(m, u.data(), D.data(), r.data(), g.data(), i);
+				for (size_t j = 0; j < m; ++j) {
+					double D_ = discount(u[j], t.size(), t.data(), f.data(), _f);
+					double r_ = spot(u[j], t.size(), t.data(), f.data(), _f);
+					double g_ = value(u[j], t.size(), t.data(), f.data(), _f);
+
+					assert (std::isnan(D[j]) == std::isnan(D_));
+					assert (std::isnan(D_) || simd::ulp(D[j], D_) <= 2);
+					assert (r[j] == r_ || (std::isnan(r[j]) && std::isnan(r_)));
+					assert (g[j] == g_ || (std::isnan(g[j]) && std::isnan(g_)));
+				}
+			}
+		}
+	}
+	{ // large curve, unsorted times
+		std::default_random_engine dre;
+		std::uniform_real_distribution<> x(-1, 40);
+		std::vector<double> t(120), f(120), u(1000), g(1000);
+		for (size_t i = 0; i < t.size(); ++i) {
+			t[i] = 0.25*(i + 1);
+			f[i] = 0.01 + 1e-4*i;
+		}
+		for (auto& ui : u)
+			ui = x(dre);
+
+		simd::evaluator e(t.size(), t.data(), f.data(), 0.03);
+		e.forward(u.size(), u.data(), g.data());
+		for (size_t j = 0; j < u.size(); ++j)
+			assert (g[j] == value(u[j], t.size(), t.data(), f.data(), 0.03) || u[j] < 0);
+	}
+}
+
+#endif // _DEBUG
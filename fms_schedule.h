@@ -0,0 +1,417 @@
+// fms_schedule.h - instruments computing cash flows when needed
+/*
+	A bond is a maturity, frequency, and coupon. The classes in fms_instrument.h store every
+	time and amount in vectors. The schedules here store only the terms and compute the time
+	and amount of cash flow k on demand, so creating one does not allocate. times() and
+	amounts() are random access iterators that can be passed to the pwflat and bootstrap
+	functions taking pointers. Convert to a vector_instrument when storage is needed.
+*/
+#pragma once
+#include <cmath>
+#include <iterator>
+#include <limits>
+#include <vector>
+#include "fms_bootstrap.h"
+#include "fms_curve.h"
+#include "fms_instrument.h"
+
+namespace fms {
+namespace instrument {
+
+	// x(s, k) for k = 0, 1, ...
+	template<class S, class X, class G>
+	class schedule_iterator {
+		const S* s;
+		size_t k;
+	public:
+		typedef std::random_access_iterator_tag iterator_category;
+		typedef X value_type;
+		typedef ptrdiff_t difference_type;
+		typedef const X* pointer;
+		typedef X reference;
+
+		schedule_iterator(const S* s = nullptr, size_t k = 0)
+			: s(s), k(k)
+		{ }
+
+		X operator*() const
+		{
+			return G()(*s, k);
+		}
+		X operator[](difference_type i) const
+		{
+			return G()(*s, k + i);
+		}
+
+		schedule_iterator& operator++()
+		{
+			++k;
+
+			return *this;
+		}
+		schedule_iterator operator++(int)
+		{
+			schedule_iterator i(*this);
+			++k;
+
+			return i;
+		}
+		schedule_iterator& operator--()
+		{
+			--k;
+
+			return *this;
+		}
+		schedule_iterator operator--(int)
+		{
+			schedule_iterator i(*this);
+			--k;
+
+			return i;
+		}
+		schedule_iterator& operator+=(difference_type i)
+		{
+			k += i;
+
+			return *this;
+		}
+		schedule_iterator& operator-=(difference_type i)
+		{
+			k -= i;
+
+			return *this;
+		}
+		schedule_iterator operator+(difference_type i) const
+		{
+			return schedule_iterator(s, k + i);
+		}
+		friend schedule_iterator operator+(difference_type i, const schedule_iterator& j)
+		{
+			return j + i;
+		}
+		schedule_iterator operator-(difference_type i) const
+		{
+			return schedule_iterator(s, k - i);
+		}
+		difference_type operator-(const schedule_iterator& i) const
+		{
+			return static_cast<difference_type>(k) - static_cast<difference_type>(i.k);
+		}
+
+		bool operator==(const schedule_iterator& i) const
+		{
+			return k == i.k;
+		}
+		bool operator!=(const schedule_iterator& i) const
+		{
+			return k != i.k;
+		}
+		bool operator<(const schedule_iterator& i) const
+		{
+			return k < i.k;
+		}
+		bool operator>(const schedule_iterator& i) const
+		{
+			return k > i.k;
+		}
+		bool operator<=(const schedule_iterator& i) const
+		{
+			return k <= i.k;
+		}
+		bool operator>=(const schedule_iterator& i) const
+		{
+			return k >= i.k;
+		}
+	};
+
+	struct time_of {
+		template<class S>
+		auto operator()(const S& s, size_t k) const -> decltype(s.time(k))
+		{
+			return s.time(k);
+		}
+	};
+	struct amount_of {
+		template<class S>
+		auto operator()(const S& s, size_t k) const -> decltype(s.amount(k))
+		{
+			return s.amount(k);
+		}
+	};
+
+	// S has time(k) and amount(k) for 0 <= k < m
+	template<class S, class U = double, class C = double>
+	struct schedule {
+		typedef schedule_iterator<S, U, time_of> time_iterator;
+		typedef schedule_iterator<S, C, amount_of> amount_iterator;
+
+		size_t m;
+
+		schedule(size_t m = 0)
+			: m(m)
+		{ }
+
+		time_iterator times() const
+		{
+			return time_iterator(static_cast<const S*>(this), 0);
+		}
+		amount_iterator amounts() const
+		{
+			return amount_iterator(static_cast<const S*>(this), 0);
+		}
+
+		// Time of last cash flow. AKA maturity, termination
+		U last() const
+		{
+			return m > 0 ? static_cast<const S*>(this)->time(m - 1) : std::numeric_limits<U>::quiet_NaN();
+		}
+
+		explicit operator vector_instrument<U,C>() const
+		{
+			return vector_instrument<U,C>(std::vector<U>(times(), times() + m), std::vector<C>(amounts(), amounts() + m));
+		}
+	};
+
+	// same cash flows as bond
+	template<class U = double, class C = double>
+	struct bond_schedule : public schedule<bond_schedule<U,C>,U,C> {
+		U maturity;
+		frequency freq;
+		C coupon;
+
+		bond_schedule(U maturity = 0, frequency freq = NONE, C coupon = 0)
+			: schedule<bond_schedule<U,C>,U,C>(periods(U(0), maturity, freq)), maturity(maturity), freq(freq), coupon(coupon)
+		{ }
+
+		U time(size_t k) const
+		{
+			U i = static_cast<U>(this->m - 1 - k);
+
+			return maturity - i/freq;
+		}
+		C amount(size_t k) const
+		{
+			return k + 1 < this->m ? coupon/freq : coupon/freq + 1;
+		}
+	};
+
+	// same cash flow as cd
+	template<class U = double, class C = double>
+	struct cd_schedule : public schedule<cd_schedule<U,C>,U,C> {
+		U maturity;
+		C coupon;
+
+		cd_schedule(U maturity = 0, C coupon = 0)
+			: schedule<cd_schedule<U,C>,U,C>(1), maturity(maturity), coupon(coupon)
+		{ }
+
+		U time(size_t) const
+		{
+			return maturity;
+		}
+		C amount(size_t) const
+		{
+			return 1 + coupon*maturity;
+		}
+	};
+
+	// same cash flows as fra
+	template<class U = double, class C = double>
+	struct fra_schedule : public schedule<fra_schedule<U,C>,U,C> {
+		U effective, termination;
+		C coupon;
+
+		fra_schedule(U effective = 0, U termination = 0, C coupon = 0)
+			: schedule<fra_schedule<U,C>,U,C>(2), effective(effective), termination(termination), coupon(coupon)
+		{ }
+
+		U time(size_t k) const
+		{
+			return k == 0 ? effective : termination;
+		}
+		C amount(size_t k) const
+		{
+			return k == 0 ? C(-1) : 1 + coupon*(termination - effective);
+		}
+	};
+
+	// fixed leg of a swap plus notional exchange: -1 at effective then the cash flows of a bond
+	// paid from effective to termination, counting back from termination
+	// initial price is 0 at the par coupon
+	template<class U = double, class C = double>
+	struct swap_schedule : public schedule<swap_schedule<U,C>,U,C> {
+		U effective, termination;
+		frequency freq;
+		C coupon;
+
+		swap_schedule(U effective = 0, U termination = 0, frequency freq = NONE, C coupon = 0)
+			: schedule<swap_schedule<U,C>,U,C>(1 + periods(effective, termination, freq)),
+			  effective(effective), termination(termination), freq(freq), coupon(coupon)
+		{ }
+
+		U time(size_t k) const
+		{
+			if (k == 0)
+				return effective;
+			U i = static_cast<U>(this->m - 1 - k);
+
+			return termination - i/freq;
+		}
+		C amount(size_t k) const
+		{
+			return k == 0 ? C(-1) : k + 1 < this->m ? coupon/freq : coupon/freq + 1;
+		}
+	};
+
+} // instrument
+
+namespace pwflat {
+
+	template<class S, class T, class F>
+	inline F present_value(const instrument::schedule<S,T,F>& s, const curve<T,F>& c)
+	{
+		return present_value(s.m,s.times(),s.amounts(), c.n,c.t,c.f,c._f);
+	}
+
+	template<class S, class T, class F>
+	inline F duration(const instrument::schedule<S,T,F>& s, const curve<T,F>& c)
+	{
+		return duration(s.m,s.times(),s.amounts(), c.n,c.t,c.f,c._f);
+	}
+
+	template<class S, class T, class F>
+	inline valuation<F> evaluate(const instrument::schedule<S,T,F>& s, const curve<T,F>& c)
+	{
+		return evaluate(s.m,s.times(),s.amounts(), c.n,c.t,c.f,c._f);
+	}
+
+} // pwflat
+
+namespace bootstrap {
+
+	// next forward to reprice schedule s at price p given curve c
+	template<class S, class T, class F>
+	inline expected<F> try_next(const instrument::schedule<S,T,F>& s, const pwflat::curve<T,F>& c, F p = 0, F _f = 0) noexcept
+	{
+		return try_next(s.m,s.times(),s.amounts(), c.n,c.t,c.f, p,_f);
+	}
+
+	template<class S, class T, class F>
+	inline F next(const instrument::schedule<S,T,F>& s, const pwflat::curve<T,F>& c, F p = 0, F _f = 0)
+	{
+		return next(s.m,s.times(),s.amounts(), c.n,c.t,c.f, p,_f);
+	}
+
+} // bootstrap
+} // fms
+
+#ifdef _DEBUG
+#include <cassert>
+#include <vector>
+#include "fms_forward.h"
+
+inline void test_fms_schedule()
+{
+	using namespace fms;
+	using namespace instrument;
+
+	pwflat::vector_curve<> f(std::vector<double>{1, 2, 3, 5, 7, 10}, std::vector<double>{.01, .015, .02, .025, .03, .035}, .04);
+
+	{
+		bond_schedule<> s(3.25, SEMIANNUAL, 0.05);
+		bond<> b(3.25, SEMIANNUAL, 0.05);
+		assert (s.m == b.m);
+		for (size_t k = 0; k < s.m; ++k) {
+			assert (s.time(k) == b.u[k] && s.times()[k] == b.u[k]);
+			assert (s.amount(k) == b.c[k] && *(s.amounts() + k) == b.c[k]);
+		}
+		assert (s.last() == b.last());
+
+		// bonds and bond schedules count periods the same way
+		double mat = 0.1*3; // 0.30000000000000004
+		assert (bond_schedule<>(10*mat, ANNUAL, 0.05).m == 3);
+		assert (bond<>(10*mat, ANNUAL, 0.05).m == 3);
+		assert (bond_schedule<>(mat + 1.7, SEMIANNUAL, 0.05).m == bond<>(mat + 1.7, SEMIANNUAL, 0.05).m);
+		assert (s.times() + s.m - s.times() == static_cast<ptrdiff_t>(s.m));
+
+		auto i = static_cast<vector_instrument<>>(s);
+		assert (i == b);
+
+		assert (pwflat::present_value(s, f) == pwflat::present_value(b, f));
+		assert (pwflat::duration(s, f) == pwflat::duration(b, f));
+		assert (pwflat::evaluate(s, f).pv == pwflat::present_value(b, f));
+
+		pwflat::vector_curve<> f2(std::vector<double>{1, 2}, std::vector<double>{.01, .015});
+		assert (bootstrap::next(s, f2, 1.) == bootstrap::next(b, f2, 1.));
+		assert (*bootstrap::try_next(s, f2, 1.) == bootstrap::next(b, f2, 1.));
+	}
+	{
+		cd_schedule<> s(0.25, 0.02);
+		cd<> d(0.25, 0.02);
+		assert (static_cast<vector_instrument<>>(s) == d);
+		assert (pwflat::present_value(s, f) == pwflat::present_value(d, f));
+	}
+	{
+		fra_schedule<> s(0.25, 0.5, 0.03);
+		fra<> g(0.25, 0.5, 0.03);
+		assert (static_cast<vector_instrument<>>(s) == g);
+		assert (pwflat::present_value(s, f) == pwflat::present_value(g, f));
+	}
+	{
+		swap_schedule<> s(1, 5, QUARTERLY, 0.03);
+		assert (s.m == 17);
+		assert (s.time(0) == 1 && s.amount(0) == -1);
+		assert (s.time(1) == 1.25 && s.amount(1) == 0.03/4);
+		assert (s.last() == 5 && s.amount(16) == 1 + 0.03/4);
+
+		// forward starting bond less notional
+		std::vector<double> u(1, 1.), c(1, -1.);
+		bond<> b(4, QUARTERLY, 0.03);
+		for (size_t k = 0; k < b.m; ++k) {
+			u.push_back(1 + b.u[k]);
+			c.push_back(b.c[k]);
+		}
+		assert (static_cast<vector_instrument<>>(s) == vector_instrument<>(u, c));
+
+		// effective dates that are not whole numbers
+		swap_schedule<> s1(1.2, 2.2, ANNUAL, .03);
+		assert (s1.m == 2);
+		assert (s1.time(0) == 1.2 && s1.amount(0) == -1);
+		assert (s1.time(1) == 2.2 && s1.amount(1) == 1.03);
+		for (int e = 0; e < 50; ++e) {
+			for (int tenor = 1; tenor <= 30; ++tenor) {
+				for (auto freq : {ANNUAL, SEMIANNUAL, QUARTERLY, MONTHLY}) {
+					swap_schedule<> se(0.1*e, 0.1*e + tenor, freq, .03);
+					assert (se.m == 1 + static_cast<size_t>(tenor*freq));
+					assert (se.time(1) > se.effective);
+					assert (fabs(se.time(1) - (se.effective + 1./freq)) < 1e-12);
+				}
+			}
+		}
+		// short first period is kept
+		swap_schedule<> s2(1.2, 2.5, SEMIANNUAL, .03);
+		assert (s2.m == 4 && s2.time(1) == 1.5); // 1.2 to 1.5
+
+		// par coupon prices to 0
+		double pv = pwflat::present_value(s, f);
+		double d1 = pwflat::present_value(swap_schedule<>(1, 5, QUARTERLY, 0.04), f) - pv;
+		double par = 0.03 - pv/(d1/0.01);
+		assert (fabs(pwflat::present_value(swap_schedule<>(1, 5, QUARTERLY, par), f)) < 1e-14);
+	}
+	{
+		// build a curve from schedules
+		pwflat::forward<> g;
+		bond_schedule<> b1(1, ANNUAL, 0.02), b2(2, ANNUAL, 0.025), b3(3, ANNUAL, 0.03);
+		g.push_back(b1.last(), bootstrap::next(b1, g, 1.));
+		g.push_back(b2.last(), bootstrap::next(b2, g, 1.));
+		g.push_back(b3.last(), bootstrap::next(b3, g, 1.));
+
+		pwflat::forward<> h;
+		h.next(bond<>(1, ANNUAL, 0.02), 1);
+		h.next(bond<>(2, ANNUAL, 0.025), 1);
+		h.next(bond<>(3, ANNUAL, 0.03), 1);
+		assert (g == h);
+	}
+}
+
+#endif // _DEBUG
@@ -0,0 +1,281 @@
+// fms_shared_instrument.h - instruments sharing cash flow times
+/*
+	Bonds and swaps of the same maturity and frequency pay on the same dates and differ only in
+	their coupons. A grid_pool keeps one copy of each distinct array of times and hands out
+	reference counted pointers to it. A shared_instrument holds such a pointer and its own amounts.
+	Times are freed when the last instrument using them is destroyed. The pool forgets them the
+	next time it sweeps, which happens when it has doubled in size since the last sweep.
+
+	present_values discounts each distinct array of times once and reuses the discounts for every
+	instrument pointing at it.
+*/
+#pragma once
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "fms_curve.h"
+#include "fms_error.h"
+#include "fms_instrument.h"
+
+namespace fms {
+
+	template<class U = double>
+	class grid_pool {
+	public:
+		typedef std::shared_ptr<const std::vector<U>> grid;
+	private:
+		std::mutex m_;
+		std::unordered_multimap<size_t, std::weak_ptr<const std::vector<U>>> g_;
+		size_t sweep_; // remove expired entries when g_ has this many
+
+		void sweep()
+		{
+			for (auto i = g_.begin(); i != g_.end(); ) {
+				if (i->second.expired())
+					i = g_.erase(i);
+				else
+					++i;
+			}
+			sweep_ = std::max<size_t>(2*g_.size(), 16);
+		}
+
+		static size_t hash(size_t m, const U* u)
+		{
+			size_t h = m;
+			for (size_t i = 0; i < m; ++i)
+				h = h*31 + std::hash<U>()(u[i]);
+
+			return h;
+		}
+	public:
+		grid_pool()
+			: sweep_(16)
+		{ }
+		grid_pool(const grid_pool&) = delete;
+		grid_pool& operator=(const grid_pool&) = delete;
+
+		// shared copy of u[0], ..., u[m-1]
+		grid intern(size_t m, const U* u)
+		{
+			size_t h = hash(m, u);
+			std::lock_guard<std::mutex> lock(m_);
+
+			auto r = g_.equal_range(h);
+			for (auto i = r.first; i != r.second; ) {
+				grid g = i->second.lock();
+				if (!g) {
+					i = g_.erase(i);
+
+					continue;
+				}
+				if (g->size() == m && std::equal(u, u + m, g->begin()))
+					return g;
+				++i;
+			}
+
+			grid g = std::make_shared<const std::vector<U>>(u, u + m);
+			if (g_.size() >= sweep_)
+				sweep();
+			g_.emplace(h, g);
+
+			return g;
+		}
+		grid intern(const std::vector<U>& u)
+		{
+			return intern(u.size(), u.data());
+		}
+
+		// number of grids in use
+		size_t size()
+		{
+			std::lock_guard<std::mutex> lock(m_);
+			sweep();
+
+			return g_.size();
+		}
+		// entries in the table including grids no longer in use
+		size_t entries()
+		{
+			std::lock_guard<std::mutex> lock(m_);
+
+			return g_.size();
+		}
+	};
+
+	// times from a grid_pool and its own amounts
+	template<class U = double, class C = double>
+	class shared_instrument : public instrument_base<U,C> {
+		typename grid_pool<U>::grid u_;
+		small_vector<C> c_;
+
+		void reset()
+		{
+			instrument_base<U,C>::m = c_.size();
+			instrument_base<U,C>::u = u_ ? u_->data() : nullptr;
+			instrument_base<U,C>::c = c_.data();
+		}
+	public:
+		shared_instrument()
+		{ }
+		shared_instrument(const typename grid_pool<U>::grid& u, const C* c)
+			: u_(u), c_(c, c + (u ? u->size() : 0))
+		{
+			reset();
+		}
+		shared_instrument(const typename grid_pool<U>::grid& u, const std::vector<C>& c)
+			: u_(u), c_(c.begin(), c.end())
+		{
+			if (!u || u->size() != c.size())
+				throw std::runtime_error(FMS_WHERE + "cash flow times must equal the number of cash flows");
+
+			reset();
+		}
+		// same cash flows as i with times interned in p
+		shared_instrument(grid_pool<U>& p, const instrument_base<U,C>& i)
+			: u_(p.intern(i.m, i.u)), c_(i.c, i.c + i.m)
+		{
+			reset();
+		}
+		shared_instrument(const shared_instrument& i)
+			: instrument_base<U,C>(), u_(i.u_), c_(i.c_)
+		{
+			reset();
+		}
+		shared_instrument(shared_instrument&& i) noexcept
+			: instrument_base<U,C>(), u_(std::move(i.u_)), c_(std::move(i.c_))
+		{
+			reset();
+			i.reset();
+		}
+		shared_instrument& operator=(const shared_instrument& i)
+		{
+			if (this != &i) {
+				u_ = i.u_;
+				c_ = i.c_;
+				reset();
+			}
+
+			return *this;
+		}
+		shared_instrument& operator=(shared_instrument&& i) noexcept
+		{
+			if (this != &i) {
+				u_ = std::move(i.u_);
+				c_ = std::move(i.c_);
+				reset();
+				i.reset();
+			}
+
+			return *this;
+		}
+		~shared_instrument()
+		{ }
+
+		const typename grid_pool<U>::grid& times() const
+		{
+			return u_;
+		}
+	};
+
+namespace pwflat {
+
+	// pv[j] and, if not null, dur[j] of k instruments
+	// instruments with the same times pointer and number of cash flows share discounts
+	// values are identical to present_value and duration
+	template<class T, class F>
+	inline void present_values(size_t k, const instrument_base<T,F>* const* i, const curve<T,F>& c, F* pv, F* dur = nullptr)
+	{
+		std::map<std::pair<const T*, size_t>, std::vector<F>> D;
+
+		for (size_t j = 0; j < k; ++j) {
+			const auto& ij = *i[j];
+			auto& Dj = D[std::make_pair(ij.u, ij.m)];
+			if (Dj.size() != ij.m) {
+				Dj.resize(ij.m);
+				discount(ij.m, ij.u, Dj.data(), c.n, c.t, c.f, c._f);
+			}
+
+			F p{0}, d{0};
+			for (size_t l = 0; l < ij.m; ++l) {
+				p += ij.c[l]*Dj[l];
+				d -= ij.u[l]*ij.c[l]*Dj[l];
+			}
+			pv[j] = p;
+			if (dur)
+				dur[j] = d;
+		}
+	}
+
+} // pwflat
+} // fms
+
+#ifdef _DEBUG
+#include <cassert>
+#include "fms_forward.h"
+
+inline void test_fms_shared_instrument()
+{
+	using namespace fms;
+	using namespace instrument;
+
+	pwflat::vector_curve<> f(std::vector<double>{1, 2, 3, 5, 7, 10}, std::vector<double>{.01, .015, .02, .025, .03, .035}, .04);
+
+	grid_pool<> pool;
+	{
+		bond<> b(5, QUARTERLY, 0.03), b2(5, QUARTERLY, 0.04), b3(7, QUARTERLY, 0.03);
+		shared_instrument<> s(pool, b), s2(pool, b2), s3(pool, b3);
+		assert (s == b && s2 == b2 && s3 == b3);
+		assert (s.times() == s2.times() && s.u == s2.u);
+		assert (s.times() != s3.times());
+		assert (pool.size() == 2);
+
+		auto t = s;
+		assert (t == s && t.u == s.u && t.c != s.c);
+		shared_instrument<> r(std::move(t));
+		assert (r == s && t.m == 0);
+		t = s3;
+		assert (t == b3 && t.times() == s3.times());
+
+		std::vector<double> c(s.m, 0.01);
+		c.back() += 1;
+		shared_instrument<> s4(pool.intern(s.m, s.u), c);
+		assert (s4 == bond<>(5, QUARTERLY, 0.04));
+		assert (s4.u == s.u);
+
+		// cd does not share with bonds
+		shared_instrument<> d(pool, cd<>(0.25, 0.02));
+		assert (pool.size() == 3);
+
+		std::vector<const instrument_base<>*> i{&s, &s2, &s3, &s4, &d, &b, &r};
+		std::vector<double> pv(i.size()), dur(i.size());
+		pwflat::present_values(i.size(), i.data(), f, pv.data(), dur.data());
+		for (size_t j = 0; j < i.size(); ++j) {
+			assert (pv[j] == pwflat::present_value(*i[j], f));
+			assert (dur[j] == pwflat::duration(*i[j], f));
+		}
+	}
+	// grids are freed with their instruments
+	assert (pool.size() == 0);
+
+	// entries for freed grids do not accumulate
+	for (int k = 1; k <= 1000; ++k) {
+		shared_instrument<> s(pool, cd<>(k/360., 0.02));
+		assert (pool.entries() <= 32);
+	}
+	{
+		std::vector<shared_instrument<>> v;
+		for (int k = 1; k <= 100; ++k)
+			v.push_back(shared_instrument<>(pool, cd<>(k/360., 0.02)));
+		assert (pool.size() == 100);
+		assert (pool.entries() <= 200);
+	}
+	assert (pool.size() == 0);
+}
+
+#endif // _DEBUG
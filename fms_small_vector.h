@@ -0,0 +1,311 @@
+// fms_small_vector.h - vector keeping a few elements inline
+/*
+	Most instruments have a handful of cash flows and most curves a few dozen points. A small_vector
+	stores up to N elements in the object and only allocates beyond that. Moving steals the heap
+	array or copies the inline elements, so data() changes when an object having inline storage is
+	moved and classes pointing into one must point again after a move.
+
+	Unused slots are value initialized, zero for arithmetic types, so X should be a cheap value type
+	like double.
+*/
+#pragma once
+#include <algorithm>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+
+namespace fms {
+
+	// heap allocations by small_vectors on this thread
+	inline size_t& small_vector_allocations()
+	{
+		static thread_local size_t count = 0;
+
+		return count;
+	}
+
+	template<class X, size_t N = 8>
+	class small_vector {
+		size_t n_;   // size
+		size_t cap_; // capacity
+		X* p_;       // buf_ or heap array
+		X buf_[N]{};
+
+		bool inline_() const
+		{
+			return p_ == buf_;
+		}
+		void release()
+		{
+			if (!inline_())
+				delete [] p_;
+			p_ = buf_;
+			cap_ = N;
+		}
+		// capacity at least n, keeping elements
+		void grow(size_t n)
+		{
+			if (n <= cap_)
+				return;
+
+			size_t cap = std::max(n, 2*cap_);
+			X* p = new X[cap];
+			++small_vector_allocations();
+			std::move(p_, p_ + n_, p);
+			release();
+			p_ = p;
+			cap_ = cap;
+		}
+		void steal(small_vector& v) noexcept
+		{
+			if (v.inline_()) {
+				std::move(v.buf_, v.buf_ + std::min(v.n_, N), buf_); // v.n_ <= N, for gcc -Warray-bounds
+			}
+			else {
+				p_ = v.p_;
+				cap_ = v.cap_;
+				v.p_ = v.buf_;
+				v.cap_ = N;
+			}
+			n_ = v.n_;
+			v.n_ = 0;
+		}
+	public:
+		typedef X value_type;
+		typedef X* iterator;
+		typedef const X* const_iterator;
+		typedef std::reverse_iterator<X*> reverse_iterator;
+		typedef std::reverse_iterator<const X*> const_reverse_iterator;
+
+		small_vector()
+			: n_(0), cap_(N), p_(buf_)
+		{ }
+		explicit small_vector(size_t n, const X& x = X())
+			: small_vector()
+		{
+			resize(n, x);
+		}
+		template<class I, class = typename std::enable_if<!std::is_integral<I>::value>::type>
+		small_vector(I b, I e)
+			: small_vector()
+		{
+			assign(b, e);
+		}
+		small_vector(const small_vector& v)
+			: small_vector(v.begin(), v.end())
+		{ }
+		small_vector(small_vector&& v) noexcept
+			: small_vector()
+		{
+			steal(v);
+		}
+		small_vector& operator=(const small_vector& v)
+		{
+			if (this != &v)
+				assign(v.begin(), v.end());
+
+			return *this;
+		}
+		small_vector& operator=(small_vector&& v) noexcept
+		{
+			if (this != &v) {
+				release();
+				steal(v);
+			}
+
+			return *this;
+		}
+		~small_vector()
+		{
+			release();
+		}
+
+		template<class I>
+		void assign(I b, I e)
+		{
+			size_t n = std::distance(b, e);
+			if (n > cap_) {
+				release();
+				n_ = 0;
+				grow(n);
+			}
+			std::copy(b, e, p_);
+			n_ = n;
+		}
+
+		size_t size() const
+		{
+			return n_;
+		}
+		bool empty() const
+		{
+			return n_ == 0;
+		}
+		size_t capacity() const
+		{
+			return cap_;
+		}
+		// true if the elements are stored in the object
+		bool is_inline() const
+		{
+			return inline_();
+		}
+
+		X* data()
+		{
+			return p_;
+		}
+		const X* data() const
+		{
+			return p_;
+		}
+		X& operator[](size_t i)
+		{
+			return p_[i];
+		}
+		const X& operator[](size_t i) const
+		{
+			return p_[i];
+		}
+		X& back()
+		{
+			return p_[n_ - 1];
+		}
+		const X& back() const
+		{
+			return p_[n_ - 1];
+		}
+
+		iterator begin()
+		{
+			return p_;
+		}
+		iterator end()
+		{
+			return p_ + n_;
+		}
+		const_iterator begin() const
+		{
+			return p_;
+		}
+		const_iterator end() const
+		{
+			return p_ + n_;
+		}
+		reverse_iterator rbegin()
+		{
+			return reverse_iterator(end());
+		}
+		reverse_iterator rend()
+		{
+			return reverse_iterator(begin());
+		}
+
+		void reserve(size_t n)
+		{
+			grow(n);
+		}
+		void resize(size_t n, const X& x = X())
+		{
+			grow(n);
+			if (n > n_)
+				std::fill(p_ + n_, p_ + n, x);
+			n_ = n;
+		}
+		// strong guarantee: unchanged if allocation fails
+		void push_back(const X& x)
+		{
+			if (n_ == cap_) {
+				X y(x); // x may be an element
+				grow(n_ + 1);
+				p_[n_++] = y;
+			}
+			else {
+				p_[n_++] = x;
+			}
+		}
+		void pop_back()
+		{
+			--n_;
+		}
+		void clear()
+		{
+			n_ = 0;
+		}
+
+		void swap(small_vector& v) noexcept
+		{
+			small_vector w(std::move(v));
+			v = std::move(*this);
+			*this = std::move(w);
+		}
+
+		bool operator==(const small_vector& v) const
+		{
+			return n_ == v.n_ && std::equal(begin(), end(), v.begin());
+		}
+		bool operator!=(const small_vector& v) const
+		{
+			return !operator==(v);
+		}
+	};
+
+} // fms
+
+#ifdef _DEBUG
+#include <cassert>
+#include <vector>
+
+inline void test_fms_small_vector()
+{
+	using fms::small_vector;
+	using fms::small_vector_allocations;
+
+	size_t a = small_vector_allocations();
+	{
+		small_vector<double, 4> v;
+		assert (v.empty() && v.capacity() == 4 && v.is_inline());
+		for (int i = 0; i < 4; ++i)
+			v.push_back(i);
+		assert (v.size() == 4 && v.is_inline());
+		assert (small_vector_allocations() == a);
+
+		v.push_back(v[0]);
+		assert (!v.is_inline() && v.size() == 5 && v.back() == 0);
+		assert (small_vector_allocations() == a + 1);
+		for (int i = 0; i < 4; ++i)
+			assert (v[i] == i);
+
+		// moving a heap vector steals the array
+		const double* p = v.data();
+		small_vector<double, 4> w(std::move(v));
+		assert (w.data() == p && w.size() == 5);
+		assert (v.empty() && v.is_inline());
+		assert (small_vector_allocations() == a + 1);
+
+		// copying allocates
+		small_vector<double, 4> x(w);
+		assert (x == w && x.data() != w.data());
+		assert (small_vector_allocations() == a + 2);
+
+		// moving an inline vector copies the elements
+		small_vector<double, 4> y(3, 1.5);
+		small_vector<double, 4> z(std::move(y));
+		assert (z.size() == 3 && z.is_inline() && z[2] == 1.5);
+		assert (small_vector_allocations() == a + 2);
+
+		z.swap(x);
+		assert (z.size() == 5 && x.size() == 3 && x[0] == 1.5);
+		assert (small_vector_allocations() == a + 2);
+
+		std::vector<double> s{3, 2, 1};
+		z.assign(s.begin(), s.end());
+		assert (z.size() == 3 && z[0] == 3);
+		z.resize(2);
+		assert (z.size() == 2 && z.back() == 2);
+		std::reverse(z.rbegin(), z.rend());
+		assert (z[0] == 2 && z[1] == 3);
+	}
+}
+
+#endif // _DEBUG
@@ -0,0 +1,291 @@
+// fms_thread_pool.h - work stealing thread pool
+/*
+	Each worker has its own queue. Tasks submitted from a worker go to the back of its queue and
+	other tasks are dealt round robin. A worker takes tasks from the back of its own queue and,
+	when that is empty, steals from the front of the others so long jobs do not leave cores idle.
+	The thread calling wait() also runs tasks until all submitted tasks are done.
+
+	An exception thrown by a task is caught so the other tasks still run. wait() rethrows the
+	first one once all tasks are done. Tasks must not call wait() on their own pool since the
+	calling task would be waiting for itself.
+*/
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "fms_error.h"
+
+namespace fms {
+
+	class thread_pool {
+		struct queue {
+			std::mutex m;
+			std::deque<std::function<void()>> q;
+		};
+		std::vector<std::unique_ptr<queue>> q_;
+		std::vector<std::thread> w_;
+		std::atomic<size_t> queued_;  // tasks in queues
+		std::atomic<size_t> pending_; // tasks submitted and not finished
+		std::atomic<size_t> next_;    // round robin queue for outside submits
+		std::atomic<size_t> stolen_;  // tasks run by a worker other than the one queued on
+		std::mutex m_;
+		std::condition_variable work_, done_;
+		bool stop_;
+		std::exception_ptr error_;    // first exception thrown by a task
+
+		// worker index of this thread in pool p, or size() if not a worker of p
+		static size_t& index()
+		{
+			static thread_local size_t i = 0;
+
+			return i;
+		}
+		static const thread_pool*& owner()
+		{
+			static thread_local const thread_pool* p = nullptr;
+
+			return p;
+		}
+		// pool whose task this thread is running, if any
+		static const thread_pool*& running()
+		{
+			static thread_local const thread_pool* p = nullptr;
+
+			return p;
+		}
+
+		bool pop(size_t i, std::function<void()>& task)
+		{
+			std::lock_guard<std::mutex> lock(q_[i]->m);
+			auto& q = q_[i]->q;
+
+			if (q.empty())
+				return false;
+			task = std::move(q.back());
+			q.pop_back();
+			--queued_;
+
+			return true;
+		}
+		bool steal(size_t i, std::function<void()>& task)
+		{
+			for (size_t j = 1; j <= q_.size(); ++j) {
+				size_t k = (i + j) % q_.size();
+				std::lock_guard<std::mutex> lock(q_[k]->m);
+				auto& q = q_[k]->q;
+
+				if (!q.empty()) {
+					task = std::move(q.front());
+					q.pop_front();
+					--queued_;
+					if (k != i)
+						++stolen_;
+
+					return true;
+				}
+			}
+
+			return false;
+		}
+		void run(std::function<void()>& task)
+		{
+			const thread_pool* p = running();
+			running() = this;
+			try {
+				task();
+			}
+			catch (...) {
+				std::lock_guard<std::mutex> lock(m_);
+				if (!error_)
+					error_ = std::current_exception();
+			}
+			running() = p;
+			task = nullptr;
+			if (--pending_ == 0) {
+				std::lock_guard<std::mutex> lock(m_);
+				done_.notify_all();
+			}
+		}
+		void work(size_t i)
+		{
+			owner() = this;
+			index() = i;
+
+			std::function<void()> task;
+			for (;;) {
+				if (pop(i, task) || steal(i, task)) {
+					run(task);
+				}
+				else {
+					std::unique_lock<std::mutex> lock(m_);
+					work_.wait(lock, [this]() { return stop_ || queued_ > 0; });
+					if (stop_ && queued_ == 0)
+						return;
+				}
+			}
+		}
+	public:
+		explicit thread_pool(size_t n = std::thread::hardware_concurrency())
+			: queued_(0), pending_(0), next_(0), stolen_(0), stop_(false)
+		{
+			if (n == 0)
+				n = 1;
+			for (size_t i = 0; i < n; ++i)
+				q_.emplace_back(new queue);
+			for (size_t i = 0; i < n; ++i)
+				w_.emplace_back(&thread_pool::work, this, i);
+		}
+		thread_pool(const thread_pool&) = delete;
+		thread_pool& operator=(const thread_pool&) = delete;
+		~thread_pool()
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_);
+				stop_ = true;
+			}
+			work_.notify_all();
+			for (auto& w : w_)
+				w.join();
+		}
+
+		size_t size() const
+		{
+			return w_.size();
+		}
+		// number of tasks run by a worker that stole them
+		size_t stolen() const
+		{
+			return stolen_;
+		}
+		// index of the calling worker, or size() if it is not a worker of this pool
+		size_t worker() const
+		{
+			return owner() == this ? index() : size();
+		}
+
+		void submit(std::function<void()> task)
+		{
+			size_t i = owner() == this ? index() : next_++ % q_.size();
+
+			++pending_;
+			{
+				std::lock_guard<std::mutex> lock(q_[i]->m);
+				q_[i]->q.push_back(std::move(task));
+				++queued_;
+			}
+			{
+				std::lock_guard<std::mutex> lock(m_);
+				work_.notify_one();
+				done_.notify_all(); // a thread in wait() helps with tasks submitted by tasks
+			}
+		}
+
+		// run tasks on this thread until every submitted task has finished
+		// then rethrow the first exception thrown by a task, if any
+		void wait()
+		{
+			if (running() == this)
+				throw std::runtime_error(FMS_WHERE + "tasks cannot wait on their own pool");
+
+			std::function<void()> task;
+			while (pending_ > 0) {
+				if (steal(0, task)) {
+					run(task);
+				}
+				else {
+					std::unique_lock<std::mutex> lock(m_);
+					done_.wait(lock, [this]() { return pending_ == 0 || queued_ > 0; });
+				}
+			}
+
+			std::exception_ptr e;
+			{
+				std::lock_guard<std::mutex> lock(m_);
+				std::swap(e, error_);
+			}
+			if (e)
+				std::rethrow_exception(e);
+		}
+	};
+
+} // fms
+
+#ifdef _DEBUG
+#include <cassert>
+#include <string>
+
+inline void test_fms_thread_pool()
+{
+	for (size_t n : {1, 2, 4}) {
+		fms::thread_pool pool(n);
+		assert (pool.size() == n);
+
+		std::atomic<size_t> sum(0);
+		for (size_t i = 1; i <= 1000; ++i)
+			pool.submit([&sum,i]() { sum += i; });
+		pool.wait();
+		assert (sum == 1000*1001/2);
+
+		// tasks submitting tasks
+		sum = 0;
+		for (size_t i = 0; i < 10; ++i)
+			pool.submit([&pool,&sum]() {
+				for (size_t j = 0; j < 10; ++j)
+					pool.submit([&sum]() { ++sum; });
+			});
+		pool.wait();
+		assert (sum == 100);
+
+		// tasks run by each worker and, last, the thread calling wait
+		std::vector<std::atomic<size_t>> ran(n + 1);
+		for (auto& r : ran)
+			r = 0;
+		for (size_t i = 0; i < 100; ++i)
+			pool.submit([&pool,&ran]() { ++ran[pool.worker()]; });
+		pool.wait();
+		sum = 0;
+		for (auto& r : ran)
+			sum += r;
+		assert (sum == 100);
+		assert (pool.worker() == pool.size());
+
+		// a throwing task does not stop the others and is rethrown once by wait
+		sum = 0;
+		for (size_t i = 0; i < 100; ++i)
+			pool.submit([&sum,i]() {
+				if (i % 10 == 3)
+					throw std::runtime_error("task failed");
+				++sum;
+			});
+		bool thrown = false;
+		try {
+			pool.wait();
+		}
+		catch (const std::runtime_error& e) {
+			thrown = std::string(e.what()) == "task failed";
+		}
+		assert (thrown);
+		assert (sum == 90);
+		pool.wait();
+
+		// waiting inside a task is an error, not a deadlock
+		pool.submit([&pool]() { pool.wait(); });
+		thrown = false;
+		try {
+			pool.wait();
+		}
+		catch (const std::runtime_error&) {
+			thrown = true;
+		}
+		assert (thrown);
+	}
+}
+
+#endif // _DEBUG
@@ -1,6 +1,10 @@
 // newton.h - newton method for root finding
 #pragma once
+#include <algorithm>
+#include <cmath>
 #include <functional>
+#include <limits>
+#include <utility>
 
 namespace fms {
 namespace newton {
@@ -37,6 +41,97 @@ namespace newton {
 		return fabs(f(x_)) < fabs(f(x)) ? x_ : x;
 	}
 
+	enum status {
+		CONVERGED,      // step or value within tolerance
+		MAX_ITERATIONS, // iteration bound reached
+		NOT_FINITE      // function or derivative not finite and no bracket to fall back on
+	};
+
+	template<class X>
+	struct result {
+		X x;               // best point found
+		X fx;              // function value at x
+		size_t iterations; // number of function evaluations after the first
+		newton::status status;
+	};
+
+	// solve g(x).first = 0 where g returns the value and derivative at x in one call
+	// take newton steps until a sign change brackets the root, then bisect whenever a step leaves the bracket
+	// or is not half the size of the previous step
+	// a step to a point where g is not finite is halved back towards the previous point
+	// stop when |x_{k+1} - x_k| <= tol max(|x_k|, 1) or after max_iter evaluations
+	template<class X, class G>
+	inline result<X> solve(X x, const G& g, const X& tol = 2*std::numeric_limits<X>::epsilon(), size_t max_iter = 100)
+	{
+		static const X NaN = std::numeric_limits<X>::quiet_NaN();
+		result<X> r{x, NaN, 0, MAX_ITERATIONS};
+		X a = NaN, fa = NaN; // bracket with f(a) f(b) < 0 once b is not NaN
+		X b = NaN;           // only the sign of f(a) is needed to update the bracket
+		X x_ = NaN, y_ = NaN; // previous point with finite value
+		X dx = std::numeric_limits<X>::infinity();
+
+		for (auto v = g(x); ; v = g(x)) {
+			X y = v.first, dy = v.second;
+
+			if (!std::isfinite(y) || !std::isfinite(dy)) {
+				if (std::isnan(x_)) {
+					r.status = NOT_FINITE;
+
+					return r;
+				}
+				// back off towards the last good point
+				dx /= 2;
+				x = x_ + dx;
+			}
+			else {
+				if (!(fabs(y) >= fabs(r.fx))) { // true if r.fx is NaN
+					r.x = x;
+					r.fx = y;
+				}
+				if (y == 0 || fabs(dx) <= tol*std::max<X>(fabs(x), 1)) {
+					r.status = CONVERGED;
+
+					return r;
+				}
+
+				if (std::isnan(b)) {
+					if (!std::isnan(y_) && (y < 0) != (y_ < 0)) {
+						a = x_;
+						fa = y_;
+						b = x;
+					}
+				}
+				else if ((y < 0) == (fa < 0)) {
+					a = x;
+					fa = y;
+				}
+				else {
+					b = x;
+				}
+
+				// bisect if newton leaves the bracket or does not halve the previous step
+				X x1 = dy != 0 ? x - y/dy : NaN;
+				if (!std::isnan(b)) {
+					if (!(std::min(a, b) < x1 && x1 < std::max(a, b)) || fabs(x1 - x) > fabs(dx)/2)
+						x1 = a + (b - a)/2;
+				}
+				else if (std::isnan(x1)) {
+					r.status = NOT_FINITE;
+
+					return r;
+				}
+
+				x_ = x;
+				y_ = y;
+				dx = x1 - x;
+				x = x1;
+			}
+
+			if (++r.iterations == max_iter)
+				return r;
+		}
+	}
+
 } // newton
 } // fms
 
@@ -62,6 +157,44 @@ inline void test_fms_newton(int n = 0/*1000*/)
 			assert (fabs(sqrta - r) <= 20*std::numeric_limits<double>::epsilon());
 		}
 	}
+	{ // value and derivative in one call
+		auto g = [](double x) { return std::make_pair(x*x - 2, 2*x); };
+		auto r = fms::newton::solve(1., g);
+		assert (r.status == fms::newton::CONVERGED);
+		assert (fabs(r.x - sqrt(2.)) <= 2*std::numeric_limits<double>::epsilon());
+		assert (r.iterations < 10);
+	}
+	{ // newton cycles between 0 and 1
+		auto g = [](double x) { return std::make_pair(x*x*x - 2*x + 2, 3*x*x - 2); };
+		auto r = fms::newton::solve(0., g, 1e-15, 20);
+		assert (r.status == fms::newton::MAX_ITERATIONS);
+		assert (r.iterations == 20);
+		assert (r.fx == 1);
+	}
+	{ // newton diverges for atan but the bracket found after the first step does not
+		auto g = [](double x) { return std::make_pair(atan(x), 1/(1 + x*x)); };
+		auto r = fms::newton::solve(1.5, g);
+		assert (r.status == fms::newton::CONVERGED);
+		assert (fabs(r.x) < 1e-15);
+	}
+	{ // step out of the domain is halved
+		auto g = [](double x) { return std::make_pair(log(x) - 1, 1/x); };
+		auto r = fms::newton::solve(10., g);
+		assert (r.status == fms::newton::CONVERGED);
+		assert (fabs(r.x - exp(1.)) <= 4*std::numeric_limits<double>::epsilon());
+	}
+	{ // overshoot far past the root and crawl back inside the bracket
+		auto g = [](double x) { return std::make_pair(exp(10*x) - 2, 10*exp(10*x)); };
+		auto r = fms::newton::solve(-1., g);
+		assert (r.status == fms::newton::CONVERGED);
+		assert (fabs(r.x - log(2.)/10) <= 2*std::numeric_limits<double>::epsilon());
+		assert (r.iterations < 50);
+	}
+	{
+		auto g = [](double x) { return std::make_pair(sqrt(x), 0.5/sqrt(x)); };
+		auto r = fms::newton::solve(-1., g);
+		assert (r.status == fms::newton::NOT_FINITE);
+	}
 }
 
 #endif // _DEBUG
\ No newline at end of file
@@ -171,7 +171,7 @@ xfpx* WINAPI xll_pwflat_forward_integral(HANDLEX h, xfpx* pt)
 		handle<fms::pwflat::forward<>> h_(h);
 
 		f.resize(pt->rows, pt->columns);
-		std::transform(begin(*pt), end(*pt), f.begin(), [h_](double t) { return h_->integral(t); });
+		fms::pwflat::integral(size(*pt), pt->array, f.begin(), h_->n, h_->t, h_->f, h_->_f);
 	}
 	catch (const std::exception& ex) {
 		XLL_ERROR(ex.what());
@@ -199,7 +199,7 @@ xfpx* WINAPI xll_pwflat_forward_spot(HANDLEX h, xfpx* pt)
 		handle<fms::pwflat::forward<>> h_(h);
 
 		f.resize(pt->rows, pt->columns);
-		std::transform(begin(*pt), end(*pt), f.begin(), [h_](double t) { return h_->spot(t); });
+		fms::pwflat::spot(size(*pt), pt->array, f.begin(), h_->n, h_->t, h_->f, h_->_f);
 	}
 	catch (const std::exception& ex) {
 		XLL_ERROR(ex.what());
@@ -227,7 +227,7 @@ xfpx* WINAPI xll_pwflat_forward_discount(HANDLEX h, xfpx* pt)
 		handle<fms::pwflat::forward<>> h_(h);
 
 		f.resize(pt->rows, pt->columns);
-		std::transform(begin(*pt), end(*pt), f.begin(), [h_](double t) { return h_->discount(t); });
+		fms::pwflat::discount(size(*pt), pt->array, f.begin(), h_->n, h_->t, h_->f, h_->_f);
 	}
 	catch (const std::exception& ex) {
 		XLL_ERROR(ex.what());
@@ -285,7 +285,7 @@ double WINAPI xll_pwflat_forward_present_value(HANDLEX f, HANDLEX i)
 		handle<fms::pwflat::forward<>> f_(f);
 		handle<fms::vector_instrument<>> i_(i);
 
-		pv = fms::pwflat::present_value(*i_, *f_);
+		pv = fms::pwflat::evaluate(*i_, *f_).pv;
 	}
 	catch (const std::exception& ex) {
 		XLL_ERROR(ex.what());
@@ -311,7 +311,7 @@ double WINAPI xll_pwflat_forward_duration(HANDLEX f, HANDLEX i)
 		handle<fms::pwflat::forward<>> f_(f);
 		handle<fms::vector_instrument<>> i_(i);
 
-		dur = fms::pwflat::duration(*i_, *f_);
+		dur = fms::pwflat::evaluate(*i_, *f_).duration;
 	}
 	catch (const std::exception& ex) {
 		XLL_ERROR(ex.what());
@@ -322,17 +322,45 @@ double WINAPI xll_pwflat_forward_duration(HANDLEX f, HANDLEX i)
 
 #ifdef _DEBUG
 #include "fms_lmm.h"
+#include "fms_expected.h"
+#include "fms_curve_expr.h"
+#include "fms_bootstrap_batch.h"
+#include "fms_forward_build.h"
+#include "fms_portfolio.h"
+#include "fms_portfolio_pricer.h"
+#include "fms_portfolio_delta.h"
+#include "fms_portfolio_parallel.h"
+#include "fms_schedule.h"
+#include "fms_shared_instrument.h"
+#include "fms_small_vector.h"
+#include "fms_pwflat_search.h"
+#include "fms_pwflat_simd.h"
 
 XLL_TEST_BEGIN(xll_forward_test)
 //_crtBreakAlloc = 2169;
 	test_fms_newton();
+	test_fms_expected();
+	test_fms_small_vector();
 
 	test_fms_pwflat();
 	test_fms_bootstrap();
+	test_fms_bootstrap_batch();
 	test_fms_curve();
+	test_fms_curve_view();
+	test_fms_curve_expr();
 	test_fms_instrument();
+	test_fms_schedule();
+	test_fms_shared_instrument();
+	test_fms_portfolio();
+	test_fms_portfolio_pricer();
+	test_fms_portfolio_delta();
+	test_fms_portfolio_parallel();
 	test_fms_forward();
+	test_fms_forward_build();
+	test_fms_thread_pool();
 	test_fms_pwflat_lmm();
+	test_fms_pwflat_search();
+	test_fms_pwflat_simd();
 
 //	test_fms_lmm();
 